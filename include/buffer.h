@@ -2,24 +2,218 @@
 #define _BUFFER_H_
 
 #include <Arduino.h>
+#include "hal.h"
 
-/** FIFO class to implement circular buffer **/
+/** Where text written by host goes */
+enum FifoInputMode : byte
+{
+  INPUT_APPEND = 0, // normal mode: at the end of buffer
+  INPUT_INSERT,     // at input pointer, following content moves on
+  INPUT_OVERWRITE   // at input pointer, replacing content; appends when it reaches the end
+};
+
+/** Smallest index type for FIFO capacity: byte up to 256 bytes, word above */
+template <bool SMALL> struct FifoIndexType { typedef byte type; };
+template <> struct FifoIndexType<false> { typedef word type; };
+
+/** FIFO class to implement circular buffer
+ * Besides text, it carries buffered commands in-band: tag byte (command code below 0x20) followed by its parameters.
+ * Input pointer allows editing of text not yet sent. Host sets its position counted in bytes from the beginning
+ * of current message (see markOrigin()), other positions are counted from the oldest unsent byte.
+ *
+ * Capacity is a power of two, one byte of it is never used so that full and empty buffer differ.
+ * Head and tail are free running indexes, masked only when the buffer is accessed.
+ *
+ * Appending by push() is safe from interrupt context against shift() in the main loop (single producer,
+ * single consumer). Byte indexes are read and written atomically; 16-bit indexes are read twice until
+ * both reads agree, and head is written with interrupts disabled because the producer checks it.
+ * Other writing methods must not run concurrently with the interrupt producer.
+ **/
+template <unsigned int CAPACITY, typename Index = typename FifoIndexType<(CAPACITY <= 256)>::type>
 class CharacterFIFO
 {
+  static_assert(CAPACITY >= 32 && (CAPACITY & (CAPACITY - 1)) == 0, "FIFO capacity must be a power of two, at least 32");
+  static_assert(CAPACITY - 1 <= (Index)~0, "FIFO index type too small for capacity");
+
+public:
+  static const unsigned int SIZE = CAPACITY;
+  static const Index LIMIT = CAPACITY - 1; // maximum number of bytes held
+
 private:
-  char buffer[256];
-  byte head = 0;
-  byte tail = 0;
+  static const Index MASK = CAPACITY - 1;
+  char buffer[CAPACITY];
+  volatile Index head = 0; // moved by consumer only
+  volatile Index tail = 0; // moved by producer only
+  Index input = 0;  // input pointer in INPUT_INSERT and INPUT_OVERWRITE mode
+  Index origin = 0; // beginning of current message, reference for input pointer positions
+  FifoInputMode mode = INPUT_APPEND;
+
+  static Index load(const volatile Index &i)
+  {
+    Index v = i;
+    if (sizeof(Index) > 1)
+      while (v != i)
+        v = i;
+    return v;
+  }
+  void setHead(Index h)
+  {
+    if (sizeof(Index) > 1)
+      halNoInterrupts();
+    head = h;
+    if (sizeof(Index) > 1)
+      halInterrupts();
+  }
+  char &at(Index i) { return buffer[i & MASK]; }
 
 public:
-  void reset();      // reset buffer content - empty buffer
-  void push(char x); // push new character at the end of buffer
-  char shift();      // read character from
-  void unshift();
-  byte getLength();
-  byte getFree();
-  bool hasMore();
-  bool canTake();
+  /** Resets send buffer to empty state; disable interrupts around it if the interrupt producer may run */
+  void reset()
+  {
+    head = 0;   // index of the next character to be read from FIFO
+    tail = 0;   // index of the next position to place new character in FIFO
+    input = 0;
+    origin = 0;
+    mode = INPUT_APPEND;
+  }
+
+  /**
+   * Push a character at the end of buffer
+   * @return false if the buffer is full, the character is dropped
+   **/
+  bool push(char x)
+  {
+    Index t = tail;
+    if ((Index)(t - load(head)) >= LIMIT)
+      return false;
+    at(t) = x;
+    tail = t + 1;
+    return true;
+  }
+
+  /** Read the first character available for reading, zero if buffer is empty */
+  char shift()
+  {
+    Index h = head;
+    if (h == load(tail))
+      return 0;
+    char x = at(h);
+    setHead(h + 1);
+    return x;
+  }
+
+  /** Return character last read back to buffer, if it has not been overwritten meanwhile */
+  void unshift()
+  {
+    if (getLength() < LIMIT)
+      setHead(head - 1);
+  }
+
+  /** Return number of chars in the buffer **/
+  Index getLength() { return (Index)(load(tail) - load(head)); }
+
+  /** Return number of free chars in the buffer **/
+  Index getFree() { return LIMIT - getLength(); }
+
+  bool hasMore() { return load(tail) != load(head); }
+
+  bool canTake() { return getLength() < LIMIT; }
+
+  /**
+   * Push buffered command: tag byte followed by parameter bytes. Nothing is pushed if they do not fit.
+   * @return true if pushed
+   **/
+  bool pushTagged(byte tag, const byte *params, byte count)
+  {
+    if (getFree() < (Index)(count + 1))
+      return false;
+    push(tag);
+    for (byte i = 0; i < count; i++)
+      push(params[i]);
+    return true;
+  }
+
+  /** command tag, text characters are 0x20 and above */
+  static bool isTag(char x) { return (byte)x < 0x20; }
+
+  /**
+   * Put text character at input pointer according to input mode.
+   * If the input pointer has been overtaken by sending, it continues from the oldest byte.
+   * Overwrite works on a full buffer, append and insert drop the character.
+   **/
+  void write(char x)
+  {
+    if (mode == INPUT_APPEND)
+    {
+      push(x);
+      return;
+    }
+    if ((Index)(input - head) > getLength())
+      input = head; // position was already sent
+    if (mode == INPUT_OVERWRITE && input != tail)
+    {
+      at(input++) = x;
+      return;
+    }
+    if (!canTake())
+      return;
+    // insert: move following content by one position up
+    for (Index i = tail; i != input; i--)
+      at(i) = at(i - 1);
+    at(input++) = x;
+    tail = tail + 1;
+  }
+
+  /** Current message starts at the end of buffer: next byte written has position 0 **/
+  void markOrigin() { origin = tail; }
+
+  /** Return true if text goes to the end of buffer */
+  bool isAppending() { return mode == INPUT_APPEND; }
+
+  /**
+   * @param offset new input pointer position counted from the beginning of current message,
+   *   see markOrigin(). Limited to unsent part of buffer.
+   * @param m input mode; INPUT_APPEND returns to normal mode at the end of buffer
+   **/
+  void setInputPointer(Index offset, FifoInputMode m)
+  {
+    mode = m;
+    Index sent = head - origin;
+    if (offset < sent)
+      offset = sent; // cannot edit what was already sent
+    if ((Index)(offset - sent) > getLength())
+      offset = sent + getLength();
+    input = origin + offset;
+  }
+
+  /** Return input pointer position from the oldest byte; end of buffer in append mode **/
+  Index getInputOffset()
+  {
+    if (mode == INPUT_APPEND || (Index)(input - head) > getLength())
+      return (mode == INPUT_APPEND) ? getLength() : 0;
+    return input - head;
+  }
+
+  /** Return byte at position from the oldest byte **/
+  char peek(Index offset) { return at(head + offset); }
+
+  /**
+   * Remove count bytes from position offset (from the oldest byte), following content moves back.
+   * Input pointer behind the removed bytes moves back too.
+   **/
+  void erase(Index offset, Index count)
+  {
+    if (offset >= getLength())
+      return;
+    if (count > getLength() - offset)
+      count = getLength() - offset;
+    Index inputOffset = getInputOffset();
+    for (Index i = head + offset; (Index)(i + count) != tail; i++)
+      at(i) = at(i + count);
+    tail = tail - count;
+    if (mode != INPUT_APPEND && inputOffset > offset)
+      input -= (inputOffset - offset > count) ? count : inputOffset - offset;
+  }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -19,7 +19,9 @@
 
 #define CONFIG_KEYING_KEYLINE1 8
 #define CONFIG_KEYING_PTTLINE1 7
+#if !defined(CONFIG_KEYING_SIDETONE) // -D CONFIG_KEYING_SIDETONE=11 moves sidetone to OC2A, needs pot speed control
 #define CONFIG_KEYING_SIDETONE 5
+#endif
 #define CONFIG_KEYING_CPO 0
 
 #else // Make your own HW config below
@@ -30,6 +32,18 @@
 #define CONFIG_KEYING_CPO 0
 #endif
 
+/* Element timing by hardware timer (Timer1 compare match): key line edges are switched from interrupt
+ * exactly at mark and space end, and buffered elements follow each other without waiting for loop().
+ * Comment out to use loop-polled timing (every edge may be late by up to one loop iteration).
+ */
+#define CONFIG_KEYING_HW_TIMER
+
+/* Element queue: buffered text is expanded this many elements ahead into marks and spaces with precomputed
+ * durations, which are started one after another without loop() (by timer interrupt in HW timer mode).
+ * Power of two, 11 bytes of RAM each.
+ */
+#define CONFIG_KEYING_ELEMENT_QUEUE 16
+
 #define CONFIG_SIDETONE_MIN_FREQ 300
 #define CONFIG_SIDETONE_MAX_FREQ 4000
 
@@ -16,4 +16,8 @@
 
 #endif 
 
+// Paddle contacts are watched by pin change interrupt, both paddles must be on the same port.
+// After an accepted edge, further changes of the same paddle are ignored for this time (microseconds)
+#define CONFIG_PADDLE_DEBOUNCE_US 3000
+
 #endif
\ No newline at end of file
@@ -0,0 +1,15 @@
+#ifndef _CONFIG_PROFILER_H_
+#define _CONFIG_PROFILER_H_
+
+/* Loop latency profiler.
+ * When enabled, every loop() iteration and its main components are timed by micros() and collected
+ * in log2 histograms, readable and resettable by admin command 0x28 (see protocol.cpp).
+ * Costs about 200 bytes of RAM and a few tens of microseconds per loop iteration on AVR.
+ * Comment out CONFIG_LOOP_PROFILER to remove the profiler completely.
+ */
+#define CONFIG_LOOP_PROFILER
+
+// loop iterations longer than this are counted as deadline overruns (microseconds), can be changed by 0x28 command
+#define CONFIG_PROFILER_DEADLINE_US 1000
+
+#endif
@@ -1,5 +1,25 @@
+#ifndef _CONFIG_PROTOCOL_H_
+#define _CONFIG_PROTOCOL_H_
+
 #ifdef CONFIG_BAUDRATE_OVERRIDE
 const unsigned long SERIAL_SPEED = CONFIG_BAUDRATE_OVERRIDE;
 #else
 const unsigned long SERIAL_SPEED = 1200;
+#endif
+
+// Winkeyer 3 high baud rate: host selects it by admin command <00><12>, <00><11> returns to SERIAL_SPEED;
+// host close and reset return to SERIAL_SPEED too
+const unsigned long SERIAL_SPEED_HIGH = 9600;
+
+// Uncomment to detect host baud rate while host is closed: framing error or a byte above 0x7F
+// (never sent by a host before Host Open) switches between SERIAL_SPEED and SERIAL_SPEED_HIGH.
+// Host is expected to repeat Host Open when it gets no answer, as logging programs do.
+// #define CONFIG_PROTOCOL_AUTOBAUD
+
+// Text buffer capacity in bytes: power of two, at least 32; above 256 bytes the buffer uses 16-bit indexes.
+// XON/XOFF thresholds follow the capacity. Can be set per build environment, e.g. -D CONFIG_PROTOCOL_BUFFER_SIZE=128.
+#ifndef CONFIG_PROTOCOL_BUFFER_SIZE
+#define CONFIG_PROTOCOL_BUFFER_SIZE 256
+#endif
+
 #endif
\ No newline at end of file
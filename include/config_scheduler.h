@@ -0,0 +1,16 @@
+#ifndef _CONFIG_SCHEDULER_H_
+#define _CONFIG_SCHEDULER_H_
+
+/* Idle sleep of the main event loop.
+ * When enabled, loop() ends by putting the MCU into idle sleep if no component has anything to do
+ * before its next deadline. Any interrupt wakes it up: millis() timer tick, serial port, element timer,
+ * rotary encoder. Clocks and peripherals keep running in idle sleep, only the CPU stops.
+ * Comment out CONFIG_IDLE_SLEEP to keep the loop spinning all the time.
+ */
+#define CONFIG_IDLE_SLEEP
+
+// deadlines closer than this are waited for by spinning the loop (microseconds);
+// must be longer than the period of millis() timer interrupt (1024 us), which wakes the CPU at the latest
+#define CONFIG_SLEEP_GUARD_US 1100
+
+#endif
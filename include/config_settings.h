@@ -0,0 +1,20 @@
+#ifndef _CONFIG_SETTINGS_H_
+#define _CONFIG_SETTINGS_H_
+
+/* Persistent settings.
+ * Winkeyer defaults block (command 0x0F: mode, speed, sidetone, timing, speed range...) is stored in EEPROM
+ * and restored at power-up. Every save writes a whole record with sequence number and CRC into the next
+ * of the slots, so a write interrupted by power loss leaves the previous record valid, and the slots
+ * wear evenly. Changes are saved when settings stay untouched for a while, loggers send them in bursts.
+ */
+
+// first EEPROM byte used by settings records
+#define CONFIG_SETTINGS_EEPROM_BASE 0
+
+// number of record slots (17 bytes each); 16 slots multiply EEPROM endurance by 16
+#define CONFIG_SETTINGS_SLOTS 16
+
+// changed settings are saved after this quiet time (milliseconds)
+#define CONFIG_SETTINGS_SAVE_MS 2000
+
+#endif
@@ -17,7 +17,9 @@
 #elif defined(HW_CHALLENGER2)
 
 #define CONFIG_SPEEDCONTROL_USE 1
+#if !defined(CONFIG_SPEED_TYPE_POTENTIOMETER) // add -D CONFIG_SPEED_TYPE_POTENTIOMETER to build_flags for a pot
 #define CONFIG_SPEED_TYPE_ROTARY
+#endif
 #define CONFIG_SPEED_ROTARY_CLOCK 11
 #define CONFIG_SPEED_ROTARY_DATA 12
 #define CONFIG_SPEED_ROTARY_BUTTON_DIGITAL A0
@@ -35,4 +37,23 @@
 // Make your own 
 #endif
 
+/** ----- Rotary encoder decoding ----- **/
+// quadrature transitions per detent (mechanical click): 4 = rests with both contacts open, 2 = rests on every other state
+#define CONFIG_SPEED_ROTARY_STEPS 4
+// acceleration: detent following the previous one in the same direction within given time counts multiple WPM
+// set both factors to 1 to disable acceleration
+#define CONFIG_SPEED_ROTARY_ACCEL_FAST_US 15000UL
+#define CONFIG_SPEED_ROTARY_ACCEL_FAST 4
+#define CONFIG_SPEED_ROTARY_ACCEL_MEDIUM_US 40000UL
+#define CONFIG_SPEED_ROTARY_ACCEL_MEDIUM 2
+
+/** ----- Potentiometer sampling ----- **/
+// ADC conversion is started by hardware on every Timer0 overflow (1.024 ms), which already wakes idle sleep;
+// 2^OVERSAMPLE conversions are summed into one sample
+#define CONFIG_SPEED_POT_OVERSAMPLE 4
+// IIR low-pass filter of samples: new sample has weight 1/2^FILTER
+#define CONFIG_SPEED_POT_FILTER 3
+// pot has to move this percent of one WPM step beyond the current step before the speed changes
+#define CONFIG_SPEED_POT_HYSTERESIS 30
+
 #endif 
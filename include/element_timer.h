@@ -0,0 +1,25 @@
+#ifndef _ELEMENT_TIMER_H_
+#define _ELEMENT_TIMER_H_
+
+#include <Arduino.h>
+#include "config_keying.h"
+
+/**
+ * Hardware timer for element timing: Timer1 in normal mode, output compare unit A.
+ * Calls the handler in interrupt context exactly at the programmed deadline.
+ * Deadlines beyond 16-bit timer range are split into chunks internally.
+ * Timer1 is not used by the Arduino core except for analogWrite() on D9 and D10.
+ */
+class ElementTimer
+{
+public:
+  typedef void (*Handler)();
+  void init(Handler handler); // setup timer, handler is called on every deadline
+  void start(unsigned long us); // program first deadline relative to now
+  void next(unsigned long us);  // program next deadline relative to the previous one; call from handler only
+  void stop();                  // cancel deadline
+};
+
+extern ElementTimer elementTimer;
+
+#endif
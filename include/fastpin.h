@@ -0,0 +1,110 @@
+#ifndef _FASTPIN_H_
+#define _FASTPIN_H_
+
+/**
+ * Compile-time pin mapping with direct port I/O.
+ *
+ * FastPin<pin> resolves Arduino pin number to its PORT/DDR/PIN register and bit mask at compile time,
+ * so that with constant pin from config_*.h every write compiles to a single SBI/CBI instruction
+ * and every read to a single SBIS/SBIC or IN instruction, instead of several microseconds
+ * of table lookups in digitalWrite()/digitalRead(). Naming a pin that the target does not have
+ * as digital I/O is a compile error.
+ *
+ * Pin numbering follows Arduino Nano: D0-D7 = PD0-PD7, D8-D13 = PB0-PB5, A0-A5 (14-19) = PC0-PC5.
+ * LGT8F328P additionally has A6 (20) = PE1 and A7 (21) = PE3 as digital I/O, on ATmega328P these are analog only.
+ *
+ * In the native build the same interface is served by HAL, i.e. by the board simulator.
+ */
+
+#include <Arduino.h>
+#include "hal.h"
+#if !defined(CHALLENGER_NATIVE)
+#include <avr/io.h>
+#endif
+
+enum FastPort : byte
+{
+  FAST_PORT_NONE = 0,
+  FAST_PORT_B,
+  FAST_PORT_C,
+  FAST_PORT_D,
+  FAST_PORT_E
+};
+
+#if defined(__LGT8FX8P__)
+#define FASTPIN_HAS_PORT_E 1
+#else
+#define FASTPIN_HAS_PORT_E 0
+#endif
+
+/**
+ * @return port of Arduino pin, FAST_PORT_NONE if the pin is not a digital I/O pin on this target
+ */
+constexpr FastPort fastPinPort(byte pin)
+{
+  return (pin < 8) ? FAST_PORT_D : (pin < 14) ? FAST_PORT_B : (pin < 20) ? FAST_PORT_C
+       : (FASTPIN_HAS_PORT_E && (pin == 20 || pin == 21)) ? FAST_PORT_E : FAST_PORT_NONE;
+}
+
+/**
+ * @return bit number of Arduino pin within its port
+ */
+constexpr byte fastPinBit(byte pin)
+{
+  return (pin < 8) ? pin : (pin < 14) ? pin - 8 : (pin < 20) ? pin - 14 : (pin == 20) ? 1 : 3;
+}
+
+template <byte PIN>
+class FastPin
+{
+  static_assert(fastPinPort(PIN) != FAST_PORT_NONE, "Pin is not available as digital I/O on this target, check config_*.h");
+
+public:
+  static const FastPort port = fastPinPort(PIN);
+  static const byte mask = 1 << fastPinBit(PIN);
+
+#if defined(CHALLENGER_NATIVE)
+  static inline void output() { halPinMode(PIN, OUTPUT); }
+  static inline void input() { halPinMode(PIN, INPUT); }
+  static inline void inputPullup() { halPinMode(PIN, INPUT_PULLUP); }
+  static inline void high() { halDigitalWrite(PIN, HIGH); }
+  static inline void low() { halDigitalWrite(PIN, LOW); }
+  static inline byte read() { return halDigitalRead(PIN) ? 1 : 0; }
+#else
+  // register references fold to constant I/O addresses at compile time
+  static inline volatile uint8_t &portReg()
+  {
+#if FASTPIN_HAS_PORT_E
+    if (port == FAST_PORT_E) return PORTE;
+#endif
+    return (port == FAST_PORT_B) ? PORTB : (port == FAST_PORT_C) ? PORTC : PORTD;
+  }
+  static inline volatile uint8_t &ddrReg()
+  {
+#if FASTPIN_HAS_PORT_E
+    if (port == FAST_PORT_E) return DDRE;
+#endif
+    return (port == FAST_PORT_B) ? DDRB : (port == FAST_PORT_C) ? DDRC : DDRD;
+  }
+  static inline volatile uint8_t &pinReg()
+  {
+#if FASTPIN_HAS_PORT_E
+    if (port == FAST_PORT_E) return PINE;
+#endif
+    return (port == FAST_PORT_B) ? PINB : (port == FAST_PORT_C) ? PINC : PIND;
+  }
+  static inline void output() { ddrReg() |= mask; }
+  static inline void input() { ddrReg() &= ~mask; portReg() &= ~mask; }
+  static inline void inputPullup() { ddrReg() &= ~mask; portReg() |= mask; }
+  static inline void high() { portReg() |= mask; }
+  static inline void low() { portReg() &= ~mask; }
+  static inline byte read() { return (pinReg() & mask) ? 1 : 0; }
+#endif
+  static inline void write(byte level)
+  {
+    if (level) high();
+    else low();
+  }
+};
+
+#endif
\ No newline at end of file
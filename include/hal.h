@@ -0,0 +1,112 @@
+#ifndef _HAL_H_
+#define _HAL_H_
+
+/**
+ * Thin hardware abstraction layer: pins, sidetone, serial port, EEPROM and time.
+ *
+ * Functional components never call the Arduino core directly, they call hal...() functions instead.
+ * On target every function is an inline 1:1 mapping to the Arduino core, so there is no cost at all;
+ * serial port is served by own interrupt driven driver (uart.h) instead of HardwareSerial.
+ * In the native host build (CHALLENGER_NATIVE, see [env:native] in platformio.ini) the same functions
+ * are implemented by the board simulator in native/sim, which also owns the simulated clock.
+ */
+
+#include <Arduino.h>
+
+/** Serial receive callback, called in interrupt context for every received byte, also for malformed ones */
+typedef void (*HalSerialReceiver)(byte b, bool framingError);
+
+#if defined(CHALLENGER_NATIVE)
+
+// implemented in native/sim/sim.cpp
+void halPinMode(byte pin, byte mode);
+void halDigitalWrite(byte pin, byte level);
+int  halDigitalRead(byte pin);
+void halTone(byte pin, word hz);
+void halNoTone(byte pin);
+unsigned long halMillis();
+unsigned long halMicros();
+void halDelay(unsigned long ms);
+void halSerialBegin(unsigned long baud, HalSerialReceiver receiver);
+void halSerialWrite(byte b);
+bool halSerialCanWrite();
+void halSerialSetBaud(unsigned long baud);
+bool halSerialIsIdle();
+void halNoInterrupts();
+void halInterrupts();
+void halIdle();
+void halReboot();
+bool halEepromReady();
+byte halEepromRead(word address);
+void halEepromWrite(word address, byte value);
+
+#else
+
+#if defined(__LGT8F__)
+#include <EEPROM.h>
+#else
+#include <avr/eeprom.h>
+#endif
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include "uart.h"
+
+inline void halPinMode(byte pin, byte mode) { pinMode(pin, mode); }
+inline void halDigitalWrite(byte pin, byte level) { digitalWrite(pin, level); }
+inline int  halDigitalRead(byte pin) { return digitalRead(pin); }
+inline void halTone(byte pin, word hz) { tone(pin, hz); }
+inline void halNoTone(byte pin) { noTone(pin); }
+inline unsigned long halMillis() { return millis(); }
+inline unsigned long halMicros() { return micros(); }
+inline void halDelay(unsigned long ms) { delay(ms); }
+inline void halSerialBegin(unsigned long baud, HalSerialReceiver receiver) { uart.begin(baud, receiver); }
+inline void halSerialWrite(byte b) { uart.write(b); }
+inline bool halSerialCanWrite() { return uart.canWrite(); }
+inline void halSerialSetBaud(unsigned long baud) { uart.setBaud(baud); }
+inline bool halSerialIsIdle() { return uart.isIdle(); }
+inline void halNoInterrupts() { noInterrupts(); }
+inline void halInterrupts() { interrupts(); }
+
+/*
+ * Idle sleep until any interrupt. Call with interrupts disabled, returns with interrupts enabled.
+ * The instruction after SEI is always executed, so an interrupt already pending wakes the CPU immediately.
+ */
+inline void halIdle()
+{
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_enable();
+  sei();
+  sleep_cpu();
+  sleep_disable();
+}
+
+#if defined(__LGT8F__)
+/*
+ * EEPROM byte access. LGT8F328P emulates the EEPROM in flash with its own controller, the EEPROM library
+ * of the lgt8fx core drives it. A write blocks until it is done, so halEepromReady() is always true.
+ */
+inline bool halEepromReady() { return true; }
+inline byte halEepromRead(word address) { return EEPROM.read(address); }
+inline void halEepromWrite(word address, byte value) { EEPROM.write(address, value); }
+#else
+/*
+ * EEPROM byte access. A write takes about 3.4 ms and runs in background: halEepromWrite() only starts it,
+ * call it when halEepromReady() returns true, otherwise it waits for the previous write to finish.
+ */
+inline bool halEepromReady() { return eeprom_is_ready(); }
+inline byte halEepromRead(word address) { return eeprom_read_byte((const uint8_t *)address); }
+inline void halEepromWrite(word address, byte value) { eeprom_write_byte((uint8_t *)address, value); }
+#endif
+
+/*
+ * Jumping to 0x0000 will restart the whole program
+ */
+inline void halReboot()
+{
+  void (*reboot)() = 0x0000;
+  (*reboot)();
+}
+
+#endif
+
+#endif
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include <Arduino.h>
 #include "config_keying.h"
 #include "challenger.h"
+#include "fastpin.h"
+#include "speed_controller.h"
 
 //typedef
 struct KeyingFlags
@@ -48,6 +50,57 @@ struct InternalStatus {
   ElementType last: 3;
 };
 
+// Keyer queue item: high byte is item type, low byte is morse code or command parameter.
+// Commands are executed at their position in the character stream.
+enum KeyerItemType : byte
+{
+  ITEM_CODE = 0,    // morse code
+  ITEM_MERGE,       // morse code followed by the next one without character space (prosign)
+  ITEM_PTT,         // PTT on (1) or off (0)
+  ITEM_KEYDOWN,     // key down for nn seconds
+  ITEM_WAIT,        // pause for nn seconds
+  ITEM_WPM,         // speed change, nn WPM; this and the following change timing only
+  ITEM_HSCW,        // speed change, nn = lpm / 100
+  ITEM_CANCEL_SPEED // return to speed before the first buffered speed change
+};
+
+inline word keyerItem(KeyerItemType type, byte value) { return ((word)type << 8) | value; }
+
+// element timing uses fixed point microseconds with 4 fractional bits (1/16 us)
+const byte TIMING_FRACTION_BITS = 4;
+const byte TIMING_FRACTION_MASK = (1 << TIMING_FRACTION_BITS) - 1;
+
+// timing profiles: paddles, buffered text, buffered speed change by host; indexed by SpeedControlMode
+const byte SPEED_PROFILES = 3;
+
+/** Element durations of one speed, precomputed when speed, weighting, ratio or QSK compensation changes */
+struct TimingProfile
+{
+  unsigned long unitFx;    // timing unit in 1/16 us
+  unsigned long markFx[2]; // DIT and DAH key down with weighting, dah:dit ratio and QSK compensation
+  unsigned long spaceFx;   // element space with weighting
+};
+
+/** Buffered element with precomputed durations, or PTT switch alone (element NO_ELEMENT) */
+struct QueuedElement
+{
+  byte element;          // ElementType
+  byte ptt;              // PTT level switched before the element starts, PTT_KEEP = no change
+  byte ascii;            // character echoed when this element starts (first element of it), zero = none
+  unsigned long markUs;  // key down time, zero for spaces
+  unsigned long spaceUs; // key up time following the mark
+};
+const byte PTT_KEEP = 0xFF;
+
+#if defined(CONFIG_KEYING_HW_TIMER)
+// phase of the element timed by hardware timer
+enum TimerPhase : byte { TIMER_IDLE = 0, TIMER_MARK = 1, TIMER_SPACE = 2 };
+// events reported from timer interrupt to service()
+const byte TIMER_EV_MARK_END  = 1; // key line was released
+const byte TIMER_EV_SPACE_END = 2; // element finished
+const byte TIMER_EV_STARTED   = 4; // queued element was started
+#endif
+
 // union KeyerStateWord {
 //   KeyerState state ;
 //   word w ;
@@ -56,9 +109,11 @@ struct InternalStatus {
 class KeyingInterface {
 private:
   // keying interface object is supposed to be used as singleton, hence we use static constants
-  static const byte pin_keyline1 = CONFIG_KEYING_KEYLINE1; // key line, active HIGH
-  static const byte pin_pttline1 = CONFIG_KEYING_PTTLINE1; // PTT line, active HIGH
-  static const byte pin_sidetone = CONFIG_KEYING_SIDETONE; // sidetone out AC
+  typedef FastPin<CONFIG_KEYING_KEYLINE1> KeyLine1; // key line, active HIGH
+  typedef FastPin<CONFIG_KEYING_PTTLINE1> PttLine1; // PTT line, active HIGH
+  // pin 0 used to mean "not connected"; FastPin<0> would drive D0, the UART RX pin
+  static_assert(CONFIG_KEYING_KEYLINE1 != 0 && CONFIG_KEYING_PTTLINE1 != 0, "Key and PTT lines cannot be on pin 0, check config_keying.h");
+  typedef FastPin<LED_BUILTIN> BufferLed;           // buffer busy indicator
   static const byte pin_cpo_key  = CONFIG_KEYING_CPO;      // sidetone keying, active high
 
   static const word minToneFreq = CONFIG_SIDETONE_MIN_FREQ; // minimum sidetone frequency
@@ -83,10 +138,28 @@ private:
 
   // binary morse code buffer memory
   byte currentMorse = 0 ;
-  byte nextMorse = 0 ;
+  word nextItem = 0 ;          // next queue item, see KeyerItemType
+  byte currentAscii = 0 ;      // character of currentMorse to echo with its first element, zero = none or echoed
+  byte nextAscii = 0 ;         // character of nextItem
+  bool mergeCurrent = false ;  // no character space after current morse code
+  byte commandSeconds = 0 ;    // duration of KEYDOWN or WAIT element
+  volatile bool paused = false ; // buffered sending paused by host
+
+  // buffered elements expanded ahead: filled by fillQueue(), taken by timer interrupt (or service() in polling mode)
+  static const byte queueSize = CONFIG_KEYING_ELEMENT_QUEUE;
+  static_assert((queueSize & (queueSize - 1)) == 0 && queueSize <= 128, "Element queue size must be a power of two up to 128");
+  QueuedElement elementQueue[queueSize];
+  volatile byte queueHead = 0; // next element to start, free running index
+  volatile byte queueTail = 0; // next free slot, free running index
+  byte echoHead = 0;           // next started entry whose character is not echoed yet, free running index
+  void (*echoListener)(byte ascii) = nullptr; // receives characters of buffered text as they start on the air
 
   // keying parameter settings 
-  word unit = 50;           // default timing unit is 50 msec = 24 WPM
+  TimingProfile profiles[SPEED_PROFILES]; // see SpeedControlMode
+  byte activeProfile = PADDLE_SPEED;      // profile of the element in progress
+  bool bufferFollowsPaddles = true;       // buffered text uses paddle speed (host speed 0)
+  bool commandSpeed = false;              // buffered speed change in effect, see ITEM_WPM
+  byte timingResidue = 0;   // fraction of microsecond carried from element to element
   word weighting = 50 ;     // DIT duration in percent, element space is then 100 - weighting
   word ditDahFactor = 300 ; // DAH duration in percent of DIT element time including weighting
   word toneFreq = 600 ;     // default sidetone frequency
@@ -96,8 +169,11 @@ private:
   byte qskCompensation = 0 ;
 
   // internal memory to handle paddle input
-  byte paddleMemUltimatic = PADDLE_FREE ;  // remember last ultimatic decision 
+  byte paddleMemUltimatic = PADDLE_FREE ;  // paddle held alone before squeeze in Ultimatic mode
   byte paddleMemory = PADDLE_FREE ; // paddle memory for Iambic B
+  byte paddleSwitchpoint = 0 ;      // paddle memory is armed this percent of unit after mark end
+  unsigned long memoryArmUs = 0 ;   // micros() when paddle memory of the current element gets armed
+  volatile bool breakInArmed = false ; // buffered sending in progress, paddle interrupt may cut the key line
 
   // internal memory to collect paddle keying for decode
   word morseCollector = 0 ; // buffer memory to hold current morse elements
@@ -105,22 +181,49 @@ private:
   //byte asciiCollected = 0 ;
  
   // timing variables
-  unsigned long onTimer; // countdown timer for mark time in high-level sending
-  unsigned long offTimer;    // countdown timer for space time in high-level sending
-  unsigned long lastMillis ; // millisecond CPU time during the last service tick
-  unsigned long hardKeyTimeout = 0 ;
-  unsigned long collectionTimeout = 0 ;
+  // all comparisons are done on elapsed time (now - start), so they survive millis() and micros() wraparound
+  unsigned long onTimer; // countdown timer for mark time in high-level sending, us
+  unsigned long offTimer;    // countdown timer for space time in high-level sending, us
+  unsigned long lastMicros ; // microsecond CPU time during the last service tick
+  unsigned long hardKeyStart = 0 ;      // millis when forced key down started
+  word hardKeyTimeout = 0 ;             // forced key down duration, ms
+  unsigned long collectionStart = 0 ;   // micros when the last paddle character was completed
+  unsigned long collectionTimeout = 0 ; // word space detection timeout, us; zero = not running
+  bool toneActive = false ;  // sidetone currently sounding
+
+#if defined(CONFIG_KEYING_HW_TIMER)
+  // hardware timer mode: state shared with timer interrupt
+  volatile TimerPhase timerPhase = TIMER_IDLE; // phase of the element in progress
+  volatile byte timerEvents = 0;               // TIMER_EV_... flags collected since last service()
+  volatile unsigned long timerSpaceUs = 0;     // space duration of the element in progress
+  volatile ElementType startedElement = NO_ELEMENT; // element started by interrupt, not yet seen by service()
+  bool serviceTimerEvents(byte paddleState); // process interrupt events, return true when ready for next element
+  void startTimer(unsigned long markUs, unsigned long spaceUs); // start timing of the element just set up
+#endif
+  void fillQueue();          // expand buffered codes into element queue as far as it has room
+  void queueElement(ElementType element, byte ptt, byte ascii = 0); // append element with its durations to element queue
+  void reportStarted(byte head); // echo characters of entries started before queue index head
+  bool takeQueued(QueuedElement &e); // take next element from queue, switch PTT on the way; false if none
+  void clearQueue();         // drop all queued elements
+  void startElement(ElementType element, unsigned long markUs, unsigned long spaceUs); // set status, timers and lines
 
   // private methods
   word trimToneFreq(word hz);   // trim tone frequency to stay between limits or keep zero
+  void setProfileUnit(byte profile, unsigned long unitFx); // set speed of timing profile and precompute its durations
+  void computeProfile(byte profile); // precompute element durations of timing profile
   void setKey(OnOffEnum onOff); // low-level key control
   void setPtt(OnOffEnum onOff); // low-level PTT control
   KeyerState handleBreakIn() ;  // all necessary actions to set break-in condition
   void collectPaddleElement( ElementType element );
+  void elementTiming(ElementType element, unsigned long &markUs, unsigned long &spaceUs); // compute element durations
+  ElementType nextBufferElement(byte &ascii); // take next element of buffered morse code
+  void executeTimingItem();   // execute buffered speed change as soon as current code has no more elements
+  void executeItem(byte type, byte value); // execute buffered command
 
 public:
   void init();  // port setup
   bool canAccept(); // true if a binary morse code can be received by internal keying buffer
+  void clearBuffer(); // drop buffered codes and queued elements, the element in progress is finished
   void enableKey(EnableEnum enable);  // enable or disable KEY output
   void enablePtt(EnableEnum enable);  // enable or disable PTT output
   void enableTone(EnableEnum enable); // enable or disable tone
@@ -130,18 +233,29 @@ public:
   void setDefaults();                    // set default parameters
   void setFarnsworthWpm(byte wpm);       // action to respond to protocol command
   void setFirstExtension(byte ms);       // action to respond to protocol command
+  void setHscwSpeed(byte lpm100);        // set buffered text speed in hundreds of letters per minute (HSCW)
   void setKey(OnOffEnum onOff, word timeout); // low-level key control
   void setMode(KeyerMode newMode);            // action to respond to protocol command
+  void setPause(bool pause);                  // pause or resume buffered sending at element boundary
+  void setPaddleSwitchpoint(byte percent);    // action to respond to protocol command
+  void recordPaddle(byte pressed, unsigned long us); // paddles pressed at given micros(), for paddle memory
+  void paddleBreakIn();                       // called from paddle interrupt on press
   void setPttTiming(byte lead, byte tail);    // action to respond to protocol command
   void setQskCompensation(byte ms);           // action to respond to protocol command
   void setSource( KeyingSource );  // set source accordingly
-  void setTimingParameters(byte wpm, word aDahRatio = 0, word aWeighting = 0); // set time constants for given WPM speed, DAH:DIT ratio and weighting
+  void setSpeed(SpeedControlMode profile, byte wpm); // set speed of paddles, buffered text (0 = as paddles) or buffered speed change
+  void setTimingParameters(word aDahRatio, word aWeighting = 0); // set DAH:DIT ratio and weighting of all profiles, 0 = keep
   void setTone(word hz);      // low-level sidetone control
   void setToneFreq(word hz);  // set tone frequency for high-level sending
   void sendElement(ElementType element); // set status, onTimer and offTimer accordingly
   void sendPaddleElement( byte ); // determine element from paddle input and mode, and start sending
-  KeyerState sendCode( byte );  // send binary morse code; return true if accepted, false otherwise
+  KeyerState sendCode( word item, byte ascii = 0 ); // queue binary morse code or command item, see keyerItem()
+  void setEchoListener(void (*listener)(byte ascii)); // serial echo of buffered text
   KeyerState service( byte );   // read current millis, update timers, ports and status accordingly and return new service status
+  void schedule();              // tell scheduler when service() has to run again
+#if defined(CONFIG_KEYING_HW_TIMER)
+  void timerDeadline();         // called from timer interrupt exactly at mark or space end
+#endif
 };
 
 extern KeyingInterface keyer;
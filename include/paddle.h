@@ -4,29 +4,62 @@
 #include <Arduino.h>
 #include "challenger.h"
 #include "config_paddle.h"
+#include "fastpin.h"
 
 #if !defined(CONFIG_PADDLE_LEFT) || !defined(CONFIG_PADDLE_RIGHT) || CONFIG_PADDLE_LEFT == 0 || CONFIG_PADDLE_RIGHT == 0
 #error "Paddle interface is partially ot fully undefined. Check config_paddle.h"
 #endif
 
+/** Paddle state change captured by interrupt */
+struct PaddleEdge
+{
+  unsigned long us; // micros() at the edge
+  byte state;       // PaddleState after the edge
+};
+
+/**
+ * Paddle contacts are watched by pin change interrupt. Every accepted change is timestamped and put
+ * into a small lock-free queue (interrupt is the only producer, check() the only consumer), so that
+ * even a tap shorter than one loop iteration is not lost. Contact bounce is filtered in the interrupt:
+ * after an accepted edge the same paddle is ignored for CONFIG_PADDLE_DEBOUNCE_US.
+ * A press while the keyer sends buffered text releases the key line directly in the interrupt.
+ */
 class PaddleInterface {
   
   private:
 
-  static const byte pinPaddleRight = CONFIG_PADDLE_LEFT ;
-  static const byte pinPaddleLeft  = CONFIG_PADDLE_RIGHT ;
+  typedef FastPin<CONFIG_PADDLE_LEFT> PinPaddleRight ;
+  typedef FastPin<CONFIG_PADDLE_RIGHT> PinPaddleLeft ;
+
+  static const byte EDGE_QUEUE_SIZE = 8 ; // power of two
 
   bool swapPaddle = false ;
   byte lastPaddlePortBits = 0 ;
   byte ultimusBits = 0 ;
+  // written by interrupt
+  PaddleEdge edges[EDGE_QUEUE_SIZE] ;
+  volatile byte edgeHead = 0 ;       // next edge for check(), moved by check()
+  volatile byte edgeTail = 0 ;       // next free position, moved by interrupt
+  volatile byte acceptedState = 0 ;  // debounced paddle state
+  unsigned long lastEdgeUs[2] ;      // last accepted edge of DIT and DAH paddle, interrupt only
+  // read by main loop
+  byte pressed = 0 ;                 // paddles pressed since last takePressed()
+  unsigned long pressedUs = 0 ;      // time of the latest press
+  static void enableInterrupt() ;
+  byte readPins() ;
 
   public:
 
   void init() ; // setup ports and initialize variables
   void swap() ;
-  byte check();   // check paddle status
+  void setSwap(bool on) ;
+  byte check();   // check paddle status: current state including short taps captured by interrupt
+  byte takePressed(); // paddles pressed since last call, see getPressTime()
+  unsigned long getPressTime(); // micros() of the latest press returned by takePressed()
+  void schedule(); // tell scheduler when a contact change hidden by debounce has to be picked up
+  void pinChange(); // pin change interrupt handler
 };
 
 extern PaddleInterface paddle ; // PaddleInterface singleton instance
 
-#endif
\ No newline at end of file
+#endif
@@ -6,25 +6,32 @@
 #include <Arduino.h>
 #include "speed_controller.h"
 
-// minimum time to elapse between measurements
-#define POT_INTERVAL_MS 150
-
 #ifdef __LGT8FX8P__
-#define POT_FULL_SCALE ((1<<12) - 1)
+#define POT_ADC_BITS 12
 #else
-#define POT_FULL_SCALE  (1023)
+#define POT_ADC_BITS 10
 #endif
+#define POT_FULL_SCALE ((1 << POT_ADC_BITS) - 1)
 
+/**
+ * Speed potentiometer sampled by ADC conversion interrupt. Conversions are started by hardware
+ * (Timer0 overflow auto trigger), the interrupt sums 2^CONFIG_SPEED_POT_OVERSAMPLE of them into one
+ * sample of 16-bit full scale and passes it through IIR low-pass filter. update() only maps the filtered
+ * position to WPM with hysteresis, so it never waits for a conversion and the speed does not dither
+ * between two values when the pot sits on the border of two steps.
+ */
 class Potentiometer : public SpeedController
 {
   private:
-  unsigned long lastMeasurementMs = 0 ;
+  static void enableInterrupt() ;
+  bool hasPosition = false ; // value follows the pot, not the default
   public:
   void init() override ;
   void update() override;
+  static void conversionComplete(word adc) ; // ADC interrupt handler
 };
 
-#if CONFI
+#if defined(CONFIG_SPEED_TYPE_POTENTIOMETER)
 extern Potentiometer potentiometer ;
 #endif
 
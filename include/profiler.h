@@ -0,0 +1,66 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <Arduino.h>
+#include "config_profiler.h"
+
+// profiled sections of the main event loop
+enum ProfiledSection : byte
+{
+  PROF_LOOP = 0,      // whole loop() iteration
+  PROF_SPEED_CONTROL, // speedControl->update()
+  PROF_PADDLE,        // paddle.check()
+  PROF_KEYER,         // keyer.service()
+  PROF_PROTOCOL,      // protocol.service()
+  PROF_FETCH,         // protocol.getNextMorseCode()
+  PROF_DECODE,        // morse.decodeMorse()
+  PROF_SECTIONS       // number of profiled sections
+};
+
+// bucket 0: below 4 us, bucket n: 2^(n+1) to 2^(n+2)-1 us, last bucket: 4096 us and more
+const byte PROF_BUCKETS = 12;
+
+struct LatencyHistogram
+{
+  word max;                 // worst case latency in microseconds (saturated)
+  word count[PROF_BUCKETS]; // number of samples in every bucket (saturated)
+};
+
+class LoopProfiler
+{
+#if defined(CONFIG_LOOP_PROFILER)
+private:
+  LatencyHistogram histogram[PROF_SECTIONS];
+  word overruns = 0;                          // loop iterations longer than deadline
+  word deadline = CONFIG_PROFILER_DEADLINE_US; // zero = do not count overruns
+  unsigned long loopStart = 0;
+  unsigned long sectionStart = 0;
+  void record(ProfiledSection section, unsigned long us);
+
+public:
+  void reset();                    // clear all histograms and overrun counter
+  void setDeadline(word us);       // set loop deadline in microseconds
+  word getDeadline();
+  word getOverruns();
+  const LatencyHistogram &getHistogram(ProfiledSection section);
+  void startLoop();                // call at the very beginning of loop()
+  void endLoop();                  // call at the very end of loop()
+  void start();                    // start timing of a section
+  void stop(ProfiledSection section); // stop timing and record section latency
+#else
+public:
+  // profiler disabled: everything compiles to nothing
+  void reset() {}
+  void setDeadline(word us) {}
+  word getDeadline() { return 0; }
+  word getOverruns() { return 0; }
+  void startLoop() {}
+  void endLoop() {}
+  void start() {}
+  void stop(ProfiledSection section) {}
+#endif
+};
+
+extern LoopProfiler profiler;
+
+#endif
\ No newline at end of file
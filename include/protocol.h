@@ -2,9 +2,12 @@
 #define _PROTOCOL_H_
 
 #include "challenger.h"
+#include "config_protocol.h"
 #include "keying.h"
 #include "buffer.h"
 
+typedef CharacterFIFO<CONFIG_PROTOCOL_BUFFER_SIZE> TextBuffer;
+
 enum FetchProgressPhase : byte
 {
   FETCH_ANY,
@@ -13,6 +16,13 @@ enum FetchProgressPhase : byte
   EXECUTE
 };
 
+enum BaudRequest : byte
+{
+  BAUD_KEEP,
+  BAUD_LOW, // SERIAL_SPEED
+  BAUD_HIGH // SERIAL_SPEED_HIGH
+};
+
 enum WinkeyStatusMode : byte
 {
   WK1,
@@ -30,43 +40,68 @@ private:
   static const byte WK_REVISION = 22; // Winkey protocol revision number
   WinkeyStatusMode wkStatusMode = WK1; // Winkey mode; ignored
   // serial port reading variables
-  FetchProgressPhase phase = FETCH_ANY;
+  static const byte RX_RING_SIZE = 32; // power of two
+  volatile byte rxRing[RX_RING_SIZE]; // command bytes waiting for parser, filled by receive()
+  volatile byte rxHead = 0;            // next byte for parser
+  volatile byte rxTail = 0;            // next free position, moved by receive()
+  volatile byte rxOverruns = 0;        // bytes lost because the ring was full
+  volatile FetchProgressPhase phase = FETCH_ANY;
   word bytesExpected;    // total bytes to be read into param
   word bytesFetched = 0; // total bytes fetched into param
   byte command;          // command byte, prefix = 0x20 for admin commands
   byte param[16];        // command parameter(s)
   // status variables
   byte lastWkStatus = 0xC0 ; // remember last status sent
-  byte _isHostOpen;      // host status; ignored
+  volatile byte _isHostOpen; // host status; used by autobaud
+  volatile bool highBaud = false;     // link runs at SERIAL_SPEED_HIGH
+  BaudRequest pendingBaud = BAUD_KEEP; // baud rate change waiting for transmitter to finish
+  word eepromDumpIndex = 256;          // next byte of EEPROM dump, 256 = no dump in progress
+  bool dumpActive = false;             // EEPROM dump not transmitted completely, status, pot and echo wait
+  byte deferredPot = 0;                // pot value changed during EEPROM dump, zero = none
+#if defined(CONFIG_PROTOCOL_AUTOBAUD)
+  unsigned long autobaudMs = 0;        // time of the last autobaud switch, used by receive interrupt only
+#endif
   bool _sidetonePaddleOnly = false; // unused?
   bool bufferFull = false ; // flag indicating that XOFF was reported to host
-  bool breakInFlag = false ;
+  volatile bool breakInFlag = false ;
   KeyerState keyState ;
   EchoFlags echo = { serial: ON, paddle: OFF };
-  CharacterFIFO fifo; // text buffer 256 bytes
+  TextBuffer fifo; // text buffer, CONFIG_PROTOCOL_BUFFER_SIZE bytes
   void ignore(); // method to handle ignored WK commands
-  void setModeParameters();
+  void setModeParameters(byte wkMode);
+  void setSidetone(byte value);
   byte wkStatusFromKeyerState( KeyerState ks );
   void handleBreak();
   void handleBuffer();
   void handlePaddleEcho();
-  // debugging message
-  char message[80];
+  void handleProfilerCommand();
+  word bufferedCommandItem(byte tag);
+  void backspace();
+  void handleBufferPointer();
+  void sendWord(word w);
+  void requestBaud(bool high);
+  void handleBaudChange();
+  void sendEepromDump();
 
 public:
   // bool expectCmd = false;
+  void applySettings(); // configure keyer by settings (Winkeyer defaults block)
   void executeCommand();
-  byte getNextMorseCode();
+  word getNextMorseCode(byte &ascii);
   void init();
   bool isHostOpen();
+  void receive(byte b, bool framingError); // serial receive interrupt handler
   void sendPaddleEcho(byte ascii);
+  void sendSerialEcho(byte ascii);
   void sendResponse(byte);
+  void sendPotValue(byte pot);
   // void sendResponse(word);
   void sendResponse(char* str, word length);
   void sendStatus();
   void sendStatus( byte wkStatus );
   void sendStatus( KeyerState keyState );
   void service( KeyerState keyState );
+  void schedule();
   // void setStatus( KeyerStateWord keyState );
   void stopBuffer() ; 
   // testing only, M7
@@ -0,0 +1,43 @@
+#ifndef _QUADRATURE_H_
+#define _QUADRATURE_H_
+
+#include <Arduino.h>
+#include "config_speedcontrol.h"
+
+/**
+ * Full quadrature decoder for mechanical rotary encoder, hardware independent.
+ *
+ * Every change of the A/B contact pair is looked up in a transition table: a valid Gray code step
+ * moves the phase by one quarter in either direction. A step skipping a state (both contacts changed)
+ * cannot tell the direction by itself; it is counted as invalid and taken as two steps in the direction
+ * the phase already moves, or in the direction of the last detent. Contact bounce moves the phase back and forth
+ * and cancels out. A detent is counted when the encoder comes to its rest state with the phase more
+ * than half way around, so a partial or bouncing move never counts and a single lost transition does not
+ * lose the detent.
+ *
+ * Detents following each other quickly in the same direction are multiplied (acceleration), see
+ * CONFIG_SPEED_ROTARY_ACCEL_... in config_speedcontrol.h.
+ *
+ * edge() is called from pin change interrupt only, the running total is read by snapshot() in the main loop
+ * without disabling interrupts.
+ */
+class QuadratureDecoder
+{
+  static_assert(CONFIG_SPEED_ROTARY_STEPS == 4 || CONFIG_SPEED_ROTARY_STEPS == 2, "Rotary encoder must have 2 or 4 steps per detent");
+
+  byte ab = 3;               // last contact state, bit 1 = A (clock), bit 0 = B (data); 1 = open
+  signed char phase = 0;     // quarter steps since the last rest state
+  signed char lastDirection = 0;
+  unsigned long lastDetentUs = 0;
+  volatile int total = 0;    // accumulated detents including acceleration, written by edge() only
+  volatile word invalid = 0; // transitions skipping a state
+  bool isRest(byte state);
+
+public:
+  void reset(byte state);    // set contact state without counting, e.g. after power on
+  void edge(byte state, unsigned long us); // contact state changed at micros() us
+  int snapshot();            // consistent copy of the running total, safe against concurrent edge()
+  word getInvalid();
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <Arduino.h>
+#include "config_scheduler.h"
+
+/**
+ * Deadline collector for idle sleep of the main event loop.
+ *
+ * Every loop iteration starts with startLoop(). Components then tell when they need to run again:
+ * wakeNow() if they have work right now, wakeAt() with their earliest deadline in micros() time.
+ * Interrupt handlers that leave work for the main loop call signal(). At the end of the iteration
+ * sleep() puts the CPU into idle sleep, unless work is pending or the earliest deadline is too close
+ * (CONFIG_SLEEP_GUARD_US). The decision is made with interrupts disabled and sleep starts atomically
+ * with enabling them, so an interrupt can never be missed.
+ */
+class TaskScheduler
+{
+#if defined(CONFIG_IDLE_SLEEP)
+private:
+  volatile bool eventPending = false; // set by interrupt handlers
+  bool workPending = false;
+  bool hasDeadline = false;
+  unsigned long deadline = 0; // earliest deadline, micros()
+  unsigned long sleptUs = 0;  // statistics since resetStats()
+  unsigned long statsStart = 0;
+  void ageStats(unsigned long now);
+
+public:
+  void startLoop();              // call at the very beginning of loop()
+  void wakeNow();                // component has work to do now
+  void wakeAt(unsigned long us); // component has to run at micros() time us
+  void signal() { eventPending = true; } // call from interrupt handler which leaves work for main loop
+  void sleep();                  // call at the very end of loop()
+  void resetStats();
+  word getSleepPermille();       // time spent in idle sleep, recent minutes, 1/1000
+#else
+public:
+  // idle sleep disabled: everything compiles to nothing
+  void startLoop() {}
+  void wakeNow() {}
+  void wakeAt(unsigned long us) {}
+  void signal() {}
+  void sleep() {}
+  void resetStats() {}
+  word getSleepPermille() { return 0; }
+#endif
+};
+
+extern TaskScheduler scheduler;
+
+#endif
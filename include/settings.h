@@ -0,0 +1,62 @@
+#ifndef _SETTINGS_H_
+#define _SETTINGS_H_
+
+#include <Arduino.h>
+#include "config_settings.h"
+
+// Winkeyer defaults block, same order as parameters of command 0x0F and bytes 1-15 of Winkeyer EEPROM image
+enum SettingIndex : byte
+{
+  SETTING_MODE = 0,     // mode register (0x0E): paddle mode, swap, echo, autospace
+  SETTING_SPEED,        // paddle speed in WPM
+  SETTING_SIDETONE,     // 0x01 value: 4000 / frequency in Hz, bit 7 = paddle only; 0 = keyer default
+  SETTING_WEIGHT,       // 0x03
+  SETTING_LEAD,         // 0x04 PTT lead time
+  SETTING_TAIL,         // 0x04 PTT tail time
+  SETTING_MIN_WPM,      // 0x05 speed range
+  SETTING_WPM_RANGE,
+  SETTING_EXTENSION,    // 0x10 first extension
+  SETTING_COMPENSATION, // 0x11 key compensation
+  SETTING_FARNSWORTH,   // 0x0D
+  SETTING_SWITCHPOINT,  // 0x12 paddle switchpoint
+  SETTING_RATIO,        // 0x17 dah:dit ratio
+  SETTING_PIN_CONFIG,   // 0x09, stored only
+  SETTING_RESERVED,     // don't care
+  SETTINGS_SIZE
+};
+
+/**
+ * Settings kept in RAM and saved to EEPROM in background.
+ *
+ * Record in EEPROM: sequence number, SETTINGS_SIZE bytes of settings, CRC-8 of both. At power-up the valid
+ * record with the newest sequence number wins; erased or half written slots fail the CRC, and the sequence number
+ * is written last, so a half written slot is never the newest.
+ * Saving never blocks the event loop: service() writes one byte when the EEPROM is ready (3.4 ms per byte
+ * on AVR), so a record takes about 60 ms and the millis() tick keeps the loop running meanwhile.
+ */
+class SettingsStore
+{
+private:
+  static const byte RECORD_SIZE = SETTINGS_SIZE + 2;
+  byte values[SETTINGS_SIZE];
+  byte record[RECORD_SIZE]; // record being written; values may change meanwhile
+  byte slot = CONFIG_SETTINGS_SLOTS - 1; // slot of the newest record
+  byte sequence = 0;        // sequence number of the newest record
+  byte writeIndex = RECORD_SIZE; // bytes of record written so far, RECORD_SIZE = not writing
+  bool dirty = false;       // values differ from the newest record
+  unsigned long changedMs = 0;
+  static byte crc8(const byte *data, byte length);
+  static word slotAddress(byte slot);
+
+public:
+  bool load();                               // read newest valid record, factory defaults if there is none
+  byte get(SettingIndex index);
+  void set(SettingIndex index, byte value);  // change one setting, saved later
+  void setAll(const byte *block);            // change all settings (SETTINGS_SIZE bytes)
+  void service();                            // call from loop(): start saving when due, write next byte
+  bool isSaving();
+};
+
+extern SettingsStore settings;
+
+#endif
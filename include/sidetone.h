@@ -0,0 +1,52 @@
+#ifndef _SIDETONE_H_
+#define _SIDETONE_H_
+
+#include <Arduino.h>
+#include "config_keying.h"
+#include "config_paddle.h"
+#include "config_speedcontrol.h"
+
+#if CONFIG_KEYING_SIDETONE != 0 && (CONFIG_KEYING_SIDETONE == CONFIG_PADDLE_LEFT || CONFIG_KEYING_SIDETONE == CONFIG_PADDLE_RIGHT)
+#error "Sidetone pin is a paddle input (D3 = OC2B is the right paddle). Check config_keying.h and config_paddle.h"
+#endif
+#if CONFIG_KEYING_SIDETONE != 0 && defined(CONFIG_SPEED_TYPE_ROTARY) && \
+    (CONFIG_KEYING_SIDETONE == CONFIG_SPEED_ROTARY_CLOCK || CONFIG_KEYING_SIDETONE == CONFIG_SPEED_ROTARY_DATA)
+#error "Sidetone pin is a rotary encoder input (D11 = OC2A is the encoder clock of CHALLENGER2). Check config_keying.h and config_speedcontrol.h"
+#endif
+
+/**
+ * Sidetone square wave generator.
+ *
+ * When CONFIG_KEYING_SIDETONE is an output compare pin of Timer2 (D11 = OC2A or D3 = OC2B), Timer2 runs
+ * in CTC mode and the pin is toggled by the compare match hardware, so the tone costs no interrupt at all.
+ * on() and off() connect and disconnect the compare output by a single register write, the frequency
+ * divider is computed only when setFrequency() gets a new frequency.
+ * On any other pin Arduino tone() is used, which toggles the pin from Timer2 interrupt twice per period.
+ * This includes the sidetone pins of the existing boards, D5 of CHALLENGER2 and A5 of PLAST: D5 is OC0B,
+ * but Timer0 runs millis() with fixed TOP and prescaler, so its compare output cannot make a tone of
+ * chosen frequency; A5 has no timer output at all.
+ * The native build models both ways in the simulator (native/sim/sim_sidetone.cpp).
+ */
+#if CONFIG_KEYING_SIDETONE == 11 || CONFIG_KEYING_SIDETONE == 3
+#define SIDETONE_HW_TIMER
+#endif
+
+class Sidetone
+{
+  word frequency = 0; // Hz, current divider is computed for it
+#if defined(SIDETONE_HW_TIMER)
+  byte clockSelect = 0; // Timer2 prescaler bits
+  byte top = 0;         // Timer2 compare value, half period
+#endif
+
+public:
+  void init();                // set up output pin and timer, tone off
+  void setFrequency(word hz); // compute and load divider; tone keeps sounding if on
+  word getFrequency();
+  void on();                  // start square wave with current frequency
+  void off();                 // stop square wave, output low
+};
+
+extern Sidetone sidetone;
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef _TX_SCHEDULER_H_
+#define _TX_SCHEDULER_H_
+
+#include <Arduino.h>
+
+enum TxLane : byte
+{
+  TX_PRIORITY = 0, // Winkeyer status bytes and speed pot bytes
+  TX_BULK,         // echo characters and command responses
+  TX_LANES
+};
+
+/**
+ * Serial transmit scheduler. Nothing here ever waits for the serial port: bytes are queued and moved
+ * to the UART driver by service() only while it has free space, so the event loop never blocks,
+ * even at 1200 baud with 8.3 ms per byte.
+ *
+ * Priority lane holds up to two pending status bytes (0xC0-0xC7) and one pending speed pot byte (0x80|n).
+ * A newer value replaces the pending one (coalescing), so the host always gets the latest state
+ * and never a backlog of stale ones. A status that changes the break-in or XOFF bit does not replace
+ * the pending one, it is queued behind it, so the host sees every such transition even when the
+ * bytes come faster than the serial port sends them (8.3 ms at 1200 baud).
+ * Priority bytes overtake everything in the bulk lane.
+ * Bulk lane is a FIFO; bytes that do not fit are dropped.
+ * Bytes lost either way are counted per lane.
+ */
+class TxScheduler
+{
+private:
+  static const byte BULK_SIZE = 64; // power of two
+  static const byte STATUS_EDGES = 0x03; // status bits XOFF and break-in, their transitions are never coalesced
+  byte pendingStatus[2] = {0, 0};   // oldest first, zero = none
+  byte pendingPot = 0;              // zero = none
+  char bulk[BULK_SIZE];
+  byte bulkHead = 0;
+  byte bulkTail = 0;
+  word dropped[TX_LANES] = {0, 0};
+  static void saturatedIncrement(word &counter);
+
+public:
+  void sendStatus(byte status); // queue status byte, replaces pending one unless break-in or XOFF changes
+  void sendPot(byte pot);       // queue speed pot byte, replaces pending one
+  void send(byte b);            // queue byte in bulk lane
+  bool canSend();               // true if bulk lane has room for a byte
+  void service();               // move queued bytes to UART as long as it can take them
+  bool isIdle();                // true if nothing is waiting
+  word getDropped(TxLane lane); // number of bytes replaced (priority) or not fitting (bulk), saturated
+  void resetDropped();
+};
+
+extern TxScheduler txScheduler;
+
+#endif
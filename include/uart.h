@@ -0,0 +1,33 @@
+#ifndef _UART_H_
+#define _UART_H_
+
+#include <Arduino.h>
+
+/**
+ * Interrupt driven USART0 driver replacing Arduino HardwareSerial.
+ *
+ * Receive side has no buffer of its own: the receive interrupt hands every byte to the receiver callback,
+ * which runs in interrupt context and must be short (see WinkeyProtocol::receive()). Bytes with framing
+ * error are handed over too, flagged, because they indicate wrong baud rate.
+ * Transmit side is a small ring buffer drained by data register empty interrupt; write blocks when it is full,
+ * as HardwareSerial does. It is kept short on purpose: queueing is done by TxScheduler, which checks
+ * canWrite() first, so that its priority bytes do not wait behind a long backlog here.
+ *
+ * Serial (HardwareSerial) must not be referenced anywhere in the firmware, otherwise the core links
+ * its own USART interrupt vectors and the build fails with duplicate definitions.
+ */
+class Uart
+{
+public:
+  typedef void (*Receiver)(byte b, bool framingError);
+  static const byte TX_BUFFER_SIZE = 4; // power of two, holds TX_BUFFER_SIZE - 1 bytes
+  void begin(unsigned long baud, Receiver receiver); // 8N1
+  void setBaud(unsigned long baud);                  // change baud rate, safe also from interrupt
+  bool isIdle();                                     // true if all bytes written were completely sent
+  void write(byte b);
+  bool canWrite(); // true if write() would not block
+};
+
+extern Uart uart;
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * Paddle echo decoder benchmark: cost of MorseEngine::decodeMorse() per character.
+ *
+ * Usage: decode_bench [iterations]
+ *
+ * Before timing, every morse code the paddles can produce (1 to 8 elements) is decoded and checked
+ * against a reference linear search in the CODE[] table (the former implementation), and every
+ * character of the table is checked to survive asciiToCode() -> paddle code -> decodeMorse() -> asciiToCode().
+ * Any mismatch is reported and the program exits with status 1.
+ *
+ * Then every character is decoded repeatedly and the mean time per call is printed next to the time
+ * of the reference linear search. Table decode cost does not depend on character position in CODE[].
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "morse.h"
+
+static volatile char sink;
+
+/**
+ * Convert MSB-aligned table code (with stop bit) to the LSB-aligned form collected from paddles (with start bit)
+ */
+static word toPaddleCode(byte code)
+{
+  word collected = 1;
+  while (code != 0x80)
+  {
+    collected = (collected << 1) | (code >> 7);
+    code <<= 1;
+  }
+  return collected;
+}
+
+/**
+ * Former decoder: align code in a loop, then scan the table linearly
+ */
+static char referenceDecode(word code)
+{
+  if (code == 0)
+    return 0;
+  if (code == 0xFFFF)
+    return ' ';
+  if (code > 0x0100)
+    return '*';
+  code = (code << 1) | 1;
+  while ((code & 0xFF00) == 0)
+    code <<= 1;
+  byte adjusted = code & 0xFF;
+  for (byte ascii = 0x20; ascii < 0x60; ascii++)
+    if (adjusted != 0 && morse.asciiToCode(ascii) == adjusted)
+      return ascii;
+  return '~';
+}
+
+static double nsPerCall(char (*decode)(word), word code, unsigned long iterations)
+{
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < iterations; i++)
+    sink = decode(code);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+static char tableDecode(word code) { return morse.decodeMorse(code); }
+
+int main(int argc, char **argv)
+{
+  unsigned long iterations = (argc > 1) ? strtoul(argv[1], 0, 10) : 200000UL;
+  int errors = 0;
+
+  // exhaustive comparison with the former decoder over all paddle codes
+  for (word code = 1; code <= 0x0100; code++)
+  {
+    char expected = referenceDecode(code);
+    char decoded = morse.decodeMorse(code);
+    if (decoded != expected)
+    {
+      printf("MISMATCH paddle code 0x%03X: decoded '%c', expected '%c'\n", code, decoded, expected);
+      errors++;
+    }
+  }
+  // round trip of every character in the table
+  for (byte ascii = 0x20; ascii < 0x7B; ascii++)
+  {
+    byte code = morse.asciiToCode(ascii);
+    if (code == 0)
+      continue;
+    char decoded = morse.decodeMorse(toPaddleCode(code));
+    if (morse.asciiToCode(decoded) != code)
+    {
+      printf("ROUND TRIP FAILED '%c' code 0x%02X: decoded '%c'\n", ascii, code, decoded);
+      errors++;
+    }
+  }
+  printf("verification: %d error(s)\n", errors);
+  if (errors > 0)
+    return 1;
+
+  nsPerCall(tableDecode, 1, iterations); // warm up caches and clock
+  printf("%-5s %8s %10s %14s\n", "char", "elements", "table ns", "linear ns");
+  double tableMin = 1e9, tableMax = 0;
+  for (byte ascii = 0x21; ascii < 0x60; ascii++)
+  {
+    byte code = morse.asciiToCode(ascii);
+    if (code == 0)
+      continue;
+    word paddleCode = toPaddleCode(code);
+    byte elements = 0;
+    for (word c = paddleCode; c > 1; c >>= 1)
+      elements++;
+    double t = nsPerCall(tableDecode, paddleCode, iterations);
+    double r = nsPerCall(referenceDecode, paddleCode, iterations / 10);
+    if (t < tableMin)
+      tableMin = t;
+    if (t > tableMax)
+      tableMax = t;
+    printf("%-5c %8u %10.2f %14.2f\n", ascii, elements, t, r);
+  }
+  printf("table decode: min %.2f ns, max %.2f ns per character\n", tableMin, tableMax);
+  return 0;
+}
@@ -0,0 +1,205 @@
+/**
+ * Rotary encoder decoder check: replays A/B contact waveforms through QuadratureDecoder the way
+ * the pin change interrupt sees them and checks that no detent is lost or invented.
+ *
+ * Usage: encoder_replay
+ *
+ * Waveforms are generated from a list of detents (direction, time) with contact bounce on every edge
+ * and sampled with interrupt latency, i.e. the decoder only sees the contact state at the moment
+ * the interrupt reads the port, and bounce shorter than the latency is never seen at all.
+ * Scenarios: slow turns both ways, fast spins up to 2000 detents per second, bouncy contacts,
+ * direction reversal, partial moves and a lost transition. The expected total is computed
+ * independently from the detent list with the acceleration rule of config_speedcontrol.h.
+ * Finally snapshot() is checked to follow every single detent.
+ * Any mismatch is reported and the program exits with status 1.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "quadrature.h"
+
+struct Sample
+{
+  unsigned long us; // time of contact change
+  byte ab;          // new contact state
+};
+
+struct Detent
+{
+  unsigned long us; // time of the detent (rest state reached)
+  int direction;
+};
+
+static unsigned long seed = 1;
+
+static unsigned long nextRandom()
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 16) & 0x7FFF;
+}
+
+/** Forward sequence from rest: 11 -> 01 -> 00 -> 10 -> 11, clock rises while data is low */
+static const byte FORWARD[4] = {1, 0, 2, 3};
+static const byte BACKWARD[4] = {2, 0, 1, 3};
+
+/**
+ * Append one detent: four transitions evenly spread over the period before the detent time,
+ * each edge of a bouncy contact followed by bounceCount short glitches.
+ */
+static void appendDetent(std::vector<Sample> &wave, const Detent &d, unsigned long periodUs, byte bounceCount, byte steps = 4)
+{
+  const byte *seq = (d.direction > 0) ? FORWARD : BACKWARD;
+  byte previous = wave.empty() ? 3 : wave.back().ab;
+  for (byte i = 0; i < steps; i++)
+  {
+    unsigned long t = d.us - periodUs + (periodUs * (i + 1)) / 4;
+    byte next = seq[i];
+    for (byte b = 0; b < bounceCount; b++)
+    {
+      unsigned long glitch = 2 + nextRandom() % 20; // bounce pulses of a few microseconds
+      wave.push_back({t - 60 + b * 25, next});
+      wave.push_back({t - 60 + b * 25 + glitch, previous});
+    }
+    wave.push_back({t, next});
+    previous = next;
+  }
+}
+
+/**
+ * Feed waveform to decoder as pin change interrupt does: the interrupt starts latencyUs after the first change
+ * and reads whatever state the contacts have at that moment; changes during the latency raise no extra interrupt.
+ */
+static void replay(QuadratureDecoder &decoder, const std::vector<Sample> &wave, unsigned long latencyUs)
+{
+  size_t i = 0;
+  while (i < wave.size())
+  {
+    unsigned long readUs = wave[i].us + latencyUs;
+    byte state = wave[i].ab;
+    while (i < wave.size() && wave[i].us <= readUs)
+      state = wave[i++].ab;
+    decoder.edge(state, readUs);
+  }
+}
+
+/**
+ * @return total the decoder has to report for the detents, with acceleration
+ */
+static int expectedTotal(const std::vector<Detent> &detents)
+{
+  int total = 0;
+  for (size_t i = 0; i < detents.size(); i++)
+  {
+    int steps = 1;
+    if (i > 0 && detents[i].direction == detents[i - 1].direction)
+    {
+      unsigned long interval = detents[i].us - detents[i - 1].us;
+      if (interval < CONFIG_SPEED_ROTARY_ACCEL_FAST_US)
+        steps = CONFIG_SPEED_ROTARY_ACCEL_FAST;
+      else if (interval < CONFIG_SPEED_ROTARY_ACCEL_MEDIUM_US)
+        steps = CONFIG_SPEED_ROTARY_ACCEL_MEDIUM;
+    }
+    total += detents[i].direction * steps;
+  }
+  return total;
+}
+
+static int failures = 0;
+
+static void check(const char *name, int got, int expected, word invalid)
+{
+  bool ok = (got == expected);
+  printf("%-40s total %6d expected %6d invalid %3u %s\n", name, got, expected, invalid, ok ? "OK" : "FAIL");
+  if (!ok)
+    failures++;
+}
+
+/**
+ * Turn encoder by given number of detents at given rate, with bounce, and check the total
+ */
+static void spin(const char *name, int count, int direction, unsigned long periodUs, byte bounce, unsigned long latencyUs)
+{
+  QuadratureDecoder decoder;
+  decoder.reset(3);
+  std::vector<Detent> detents;
+  std::vector<Sample> wave;
+  unsigned long t = 1000000UL;
+  for (int i = 0; i < count; i++)
+  {
+    t += periodUs + nextRandom() % (periodUs / 8 + 1); // hand is not a metronome
+    detents.push_back({t, direction});
+    appendDetent(wave, detents.back(), periodUs, bounce);
+  }
+  replay(decoder, wave, latencyUs);
+  check(name, decoder.snapshot(), expectedTotal(detents), decoder.getInvalid());
+}
+
+int main()
+{
+  // the interrupt reads the port about 5 us after the change on a 16 MHz AVR
+  spin("slow clockwise", 50, +1, 200000UL, 0, 5);
+  spin("slow counterclockwise", 50, -1, 200000UL, 0, 5);
+  spin("slow clockwise, bouncy", 50, +1, 200000UL, 3, 5);
+  spin("medium spin, bouncy", 200, +1, 25000UL, 3, 5);
+  spin("fast spin, bouncy", 500, -1, 5000UL, 2, 5);
+  spin("2000 detents/s, bouncy", 1000, +1, 500UL, 1, 5);
+  spin("2000 detents/s, 20 us latency", 1000, -1, 500UL, 1, 20);
+  spin("2000 detents/s, 100 us latency", 1000, +1, 500UL, 1, 100); // interrupt misses transitions
+
+  // direction reversals with bounce: acceleration must not carry over to the other direction
+  {
+    QuadratureDecoder decoder;
+    decoder.reset(3);
+    std::vector<Detent> detents;
+    std::vector<Sample> wave;
+    unsigned long t = 1000000UL;
+    for (int i = 0; i < 300; i++)
+    {
+      t += 8000UL;
+      detents.push_back({t, (i / 7) % 2 ? -1 : +1});
+      appendDetent(wave, detents.back(), 8000UL, 2);
+    }
+    replay(decoder, wave, 5);
+    check("reversals every 7 detents", decoder.snapshot(), expectedTotal(detents), decoder.getInvalid());
+  }
+
+  // partial move: half way there and back never counts
+  {
+    QuadratureDecoder decoder;
+    decoder.reset(3);
+    std::vector<Sample> wave = {{100, 1}, {200, 0}, {300, 1}, {400, 3}, {500, 2}, {600, 3}};
+    replay(decoder, wave, 5);
+    check("partial moves", decoder.snapshot(), 0, decoder.getInvalid());
+  }
+
+  // transition lost (both contacts seen changing at once): detent still counts, direction is kept
+  {
+    QuadratureDecoder decoder;
+    decoder.reset(3);
+    std::vector<Sample> wave = {{100, 1}, {200, 2}, {300, 3}, {100000, 1}, {100100, 0}, {100200, 2}, {100300, 3}};
+    replay(decoder, wave, 5);
+    check("lost transition", decoder.snapshot(), 2, decoder.getInvalid());
+  }
+
+  // snapshot taken after every detent, as update() in a loop faster than the encoder does
+  {
+    QuadratureDecoder decoder;
+    decoder.reset(3);
+    int last = decoder.snapshot();
+    bool ok = true;
+    unsigned long t = 1000000UL;
+    for (int i = 0; i < 2000 && ok; i++)
+    {
+      t += 100000UL;
+      for (byte s = 0; s < 4; s++)
+        decoder.edge(FORWARD[s], t + s);
+      int now = decoder.snapshot();
+      ok = (now == last + 1);
+      last = now;
+    }
+    check("snapshot follows every detent", ok ? last : -1, 2000, decoder.getInvalid());
+  }
+
+  printf("%s\n", failures ? "FAILED" : "all checks passed");
+  return failures ? 1 : 0;
+}
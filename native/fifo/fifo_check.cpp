@@ -0,0 +1,289 @@
+/**
+ * Text buffer check and benchmark: CharacterFIFO of several capacities and index types is driven by
+ * random operations and compared after every step with a reference model built on std::deque.
+ *
+ * Usage: fifo_check [steps]
+ *
+ * The model keeps content in a deque and positions as 64-bit absolute byte counts, so it never wraps;
+ * only the distance of head from message origin is taken modulo the index range, as the buffer does.
+ * Operations: push, shift, unshift after shift, pushTagged, reset, and the editing used by Winkeyer
+ * commands 0x08 and 0x16: write in all input modes, markOrigin, setInputPointer, erase, peek.
+ * Length, free space, input offset and the complete content are compared after every operation.
+ * Any mismatch is reported and the program exits with status 1.
+ * Finally push and shift throughput is measured on the host for every instantiation.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <deque>
+#include "buffer.h"
+
+static unsigned long seed = 1;
+
+static unsigned long nextRandom()
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 16) & 0x7FFF;
+}
+
+/** Reference model of CharacterFIFO behaviour */
+struct Model
+{
+  unsigned long limit;     // maximum number of bytes held
+  unsigned long indexMask; // index range - 1
+  std::deque<char> content;
+  unsigned long long head = 0, tail = 0, input = 0, origin = 0;
+  FifoInputMode mode = INPUT_APPEND;
+  char lastShifted = 0;
+  bool canUnshift = false;
+
+  unsigned long length() { return content.size(); }
+  bool overtaken() { return input < head || input > tail; }
+
+  void reset()
+  {
+    content.clear();
+    head = tail = input = origin = 0;
+    mode = INPUT_APPEND;
+    canUnshift = false;
+  }
+  bool push(char x)
+  {
+    if (length() >= limit)
+      return false;
+    content.push_back(x);
+    tail++;
+    return true;
+  }
+  char shift()
+  {
+    if (content.empty())
+      return 0;
+    lastShifted = content.front();
+    content.pop_front();
+    head++;
+    canUnshift = true;
+    return lastShifted;
+  }
+  void unshift()
+  {
+    if (length() < limit)
+    {
+      content.push_front(lastShifted);
+      head--;
+    }
+    canUnshift = false;
+  }
+  bool pushTagged(byte tag, const byte *params, byte count)
+  {
+    if (limit - length() < (unsigned long)count + 1)
+      return false;
+    push(tag);
+    for (byte i = 0; i < count; i++)
+      push(params[i]);
+    return true;
+  }
+  void write(char x)
+  {
+    if (mode == INPUT_APPEND)
+    {
+      push(x);
+      return;
+    }
+    if (overtaken())
+      input = head;
+    if (mode == INPUT_OVERWRITE && input != tail)
+    {
+      content[input++ - head] = x;
+      return;
+    }
+    if (length() >= limit)
+      return;
+    content.insert(content.begin() + (input - head), x);
+    input++;
+    tail++;
+  }
+  void setInputPointer(unsigned long offset, FifoInputMode m)
+  {
+    mode = m;
+    unsigned long sent = (head - origin) & indexMask;
+    if (offset < sent)
+      offset = sent;
+    if (offset - sent > length())
+      offset = sent + length();
+    input = origin + offset;
+    if (input > tail) // origin distance wrapped: same position modulo index range
+      input -= indexMask + 1;
+  }
+  unsigned long inputOffset()
+  {
+    if (mode == INPUT_APPEND)
+      return length();
+    return overtaken() ? 0 : input - head;
+  }
+  void erase(unsigned long offset, unsigned long count)
+  {
+    if (offset >= length())
+      return;
+    if (count > length() - offset)
+      count = length() - offset;
+    unsigned long in = inputOffset();
+    content.erase(content.begin() + offset, content.begin() + offset + count);
+    tail -= count;
+    if (mode != INPUT_APPEND && in > offset)
+      input -= (in - offset > count) ? count : in - offset;
+  }
+};
+
+static unsigned long failures = 0;
+
+template <class FIFO>
+static bool compare(FIFO &fifo, Model &model, unsigned long step, const char *op)
+{
+  bool ok = fifo.getLength() == model.length() && fifo.getFree() == model.limit - model.length() &&
+            fifo.hasMore() == !model.content.empty() && fifo.canTake() == (model.length() < model.limit) &&
+            fifo.getInputOffset() == model.inputOffset();
+  for (unsigned long i = 0; ok && i < model.length(); i++)
+    ok = fifo.peek(i) == model.content[i];
+  if (!ok && failures++ < 10)
+    printf("  step %lu after %s: length %u/%lu, input offset %u/%lu\n", step, op,
+           (unsigned)fifo.getLength(), model.length(), (unsigned)fifo.getInputOffset(), model.inputOffset());
+  return ok;
+}
+
+/**
+ * Random operation sequence; push and shift are weighted so that the buffer goes through
+ * empty, half full and full states many times and its indexes wrap around
+ */
+template <class FIFO>
+static void check(const char *name, unsigned long steps)
+{
+  static FIFO fifo;
+  Model model;
+  model.limit = FIFO::LIMIT;
+  model.indexMask = (sizeof(fifo.getLength()) == 1) ? 0xFF : 0xFFFF;
+  fifo.reset();
+  unsigned long before = failures;
+  int bias = 0; // phases of mostly pushing and mostly shifting
+  for (unsigned long step = 0; step < steps; step++)
+  {
+    if (step % 5000 == 0)
+      bias = (int)(nextRandom() % 3) - 1;
+    unsigned long r = nextRandom() % 100;
+    const char *op;
+    char x = 0x20 + nextRandom() % 0x5F;
+    if ((long)r < 35 + bias * 15)
+    {
+      op = "push";
+      if (fifo.push(x) != model.push(x))
+        failures++;
+    }
+    else if (r < 70)
+    {
+      op = "shift";
+      if (fifo.shift() != model.shift())
+        failures++;
+    }
+    else if (r < 73)
+    {
+      op = "unshift";
+      if (model.canUnshift)
+      {
+        fifo.unshift();
+        model.unshift();
+      }
+    }
+    else if (r < 78)
+    {
+      op = "pushTagged";
+      byte params[3] = {(byte)nextRandom(), (byte)nextRandom(), (byte)nextRandom()};
+      byte count = nextRandom() % 4;
+      byte tag = 1 + nextRandom() % 0x1F;
+      if (fifo.pushTagged(tag, params, count) != model.pushTagged(tag, params, count))
+        failures++;
+    }
+    else if (r < 88)
+    {
+      op = "write";
+      fifo.write(x);
+      model.write(x);
+    }
+    else if (r < 91)
+    {
+      op = "markOrigin";
+      fifo.markOrigin();
+      model.origin = model.tail;
+    }
+    else if (r < 95)
+    {
+      op = "setInputPointer";
+      byte offset = nextRandom() % 256;
+      FifoInputMode m = (FifoInputMode)(nextRandom() % 3);
+      fifo.setInputPointer(offset, m);
+      model.setInputPointer(offset, m);
+    }
+    else if (r < 99)
+    {
+      op = "erase";
+      unsigned long length = model.length() + 1;
+      unsigned long offset = nextRandom() % length;
+      unsigned long count = 1 + nextRandom() % 4;
+      fifo.erase(offset, count);
+      model.erase(offset, count);
+    }
+    else
+    {
+      op = "reset";
+      fifo.reset();
+      model.reset();
+    }
+    if (!compare(fifo, model, step, op))
+    {
+      fifo.reset(); // continue from a known state
+      model.reset();
+    }
+  }
+  printf("%-28s %lu steps: %s\n", name, steps, failures == before ? "OK" : "FAILED");
+}
+
+static double seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Push and shift throughput, buffer kept half full */
+template <class FIFO>
+static void bench(const char *name)
+{
+  static FIFO fifo;
+  fifo.reset();
+  const unsigned long rounds = 20000000UL;
+  unsigned long sum = 0;
+  for (unsigned long i = 0; i < FIFO::LIMIT / 2; i++)
+    fifo.push('A');
+  double start = seconds();
+  for (unsigned long i = 0; i < rounds; i++)
+  {
+    fifo.push((char)i);
+    sum += (byte)fifo.shift();
+  }
+  double elapsed = seconds() - start;
+  printf("%-28s %6.2f ns per push + shift (checksum %lu)\n", name, elapsed * 1e9 / rounds, sum);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long steps = (argc > 1) ? strtoul(argv[1], 0, 10) : 1000000UL;
+  check<CharacterFIFO<32>>("CharacterFIFO<32>", steps);
+  check<CharacterFIFO<128>>("CharacterFIFO<128>", steps);
+  check<CharacterFIFO<256>>("CharacterFIFO<256>", steps);
+  check<CharacterFIFO<256, word>>("CharacterFIFO<256, word>", steps);
+  check<CharacterFIFO<1024>>("CharacterFIFO<1024>", steps);
+  bench<CharacterFIFO<32>>("CharacterFIFO<32>");
+  bench<CharacterFIFO<256>>("CharacterFIFO<256>");
+  bench<CharacterFIFO<1024>>("CharacterFIFO<1024>");
+  printf(failures ? "FAILED\n" : "all checks passed\n");
+  return failures ? 1 : 0;
+}
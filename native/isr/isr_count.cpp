@@ -0,0 +1,126 @@
+/**
+ * Interrupt load check: runs the unmodified firmware on the simulated board and counts interrupt entries
+ * per second by source, with the sidetone off and on.
+ *
+ * Usage: isr_count [-s seconds]
+ *   -s seconds  simulated time of every scenario (default 10 s)
+ *
+ * Scenarios:
+ *   idle      paddles open, nothing to send: sidetone off
+ *   paddles   dah paddle held: iambic dahs with sidetone, about 3/4 of the time on
+ *   keydown   buffered key down (0x19) for the whole scenario: sidetone on all the time
+ * On a Timer2 output compare pin (CONFIG_KEYING_SIDETONE 11 or 3, see include/sidetone.h) the sidetone must
+ * cost no interrupt at all; on any other pin Arduino tone() interrupts twice per period, which must match the
+ * time the sidetone was on within 1 %. Any other result is reported and the program exits with status 1.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+#include "sidetone.h"
+#include "config_paddle.h"
+
+void setup();
+void loop();
+
+static const char *SOURCES[SIM_IRQ_SOURCES] = {"millis", "alarm", "tone", "pinchange", "rx", "tx"};
+static unsigned long long toneOnUs = 0;  // sidetone on time in the scenario
+static unsigned long long toneSinceUs = 0;
+static unsigned long long toneHzUs = 0;  // sum of frequency * time, for tone() interrupt estimate
+static word toneHz = 0;
+static unsigned failed = 0;
+
+static void onTone(byte, word hz, unsigned long long us)
+{
+  if (toneHz > 0)
+  {
+    toneOnUs += us - toneSinceUs;
+    toneHzUs += (unsigned long long)toneHz * (us - toneSinceUs);
+  }
+  toneHz = hz;
+  toneSinceUs = us;
+}
+
+static void run(unsigned long long us)
+{
+  unsigned long long endUs = simBoard.now() + us;
+  while (simBoard.now() < endUs)
+  {
+    loop();
+    simBoard.advance(50);
+  }
+}
+
+/**
+ * Count interrupts of one scenario, the scenario is set up by the caller and ended by end()
+ */
+static void measure(const char *name, double seconds, void (*start)(), void (*end)())
+{
+  start();
+  run(100000); // let the scenario start
+  unsigned long long count[SIM_IRQ_SOURCES];
+  for (byte s = 0; s < SIM_IRQ_SOURCES; s++)
+    count[s] = simBoard.getInterrupts((SimInterrupt)s);
+  onTone(0, toneHz, simBoard.now());
+  toneOnUs = 0;
+  toneHzUs = 0;
+  unsigned long long startUs = simBoard.now();
+  run((unsigned long long)(seconds * 1e6));
+  onTone(0, toneHz, simBoard.now());
+  double elapsed = (simBoard.now() - startUs) / 1e6;
+  printf("%-8s tone %5.1f %% |", name, 100.0 * toneOnUs / (simBoard.now() - startUs));
+  for (byte s = 0; s < SIM_IRQ_SOURCES; s++)
+  {
+    count[s] = simBoard.getInterrupts((SimInterrupt)s) - count[s];
+    printf(" %s %.0f", SOURCES[s], count[s] / elapsed);
+  }
+#if defined(SIDETONE_HW_TIMER)
+  double expected = 0;
+#else
+  double expected = 2.0 * toneHzUs / 1e6;
+#endif
+  double diff = (double)count[SIM_IRQ_TONE] - expected;
+  bool ok = (diff < 0 ? -diff : diff) <= expected / 100 + 1;
+  printf(" per s  %s\n", ok ? "OK" : "FAILED");
+  if (!ok)
+    failed++;
+  end();
+  run(1000000);
+}
+
+static void nothing() {}
+static void holdDah() { simBoard.setInput(CONFIG_PADDLE_LEFT, LOW); }
+static void releaseDah() { simBoard.setInput(CONFIG_PADDLE_LEFT, HIGH); }
+static void keyDown()
+{
+  simBoard.hostWrite(0x19); // buffered key down, 99 s
+  simBoard.hostWrite(99);
+}
+static void clearBuffer() { simBoard.hostWrite(0x0A); }
+
+int main(int argc, char **argv)
+{
+  double seconds = 10;
+  for (int i = 1; i < argc; i++)
+    if (!strcmp(argv[i], "-s") && i + 1 < argc)
+      seconds = atof(argv[++i]);
+  simBoard.reset();
+  setup();
+  simBoard.setToneListener(onTone);
+  run(1000000); // boot beep
+  simBoard.hostWrite(0x00); // Host Open
+  simBoard.hostWrite(0x02);
+  run(500000);
+  while (simBoard.hostAvailable())
+    simBoard.hostRead();
+#if defined(SIDETONE_HW_TIMER)
+  printf("sidetone on D%u: Timer2 compare output\n", CONFIG_KEYING_SIDETONE);
+#else
+  printf("sidetone on pin %u: Arduino tone()\n", CONFIG_KEYING_SIDETONE);
+#endif
+  measure("idle", seconds, nothing, nothing);
+  measure("paddles", seconds, holdDah, releaseDah);
+  measure("keydown", seconds, keyDown, clearBuffer);
+  printf(failed ? "FAILED\n" : "interrupt load OK\n");
+  return failed ? 1 : 0;
+}
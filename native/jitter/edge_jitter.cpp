@@ -0,0 +1,149 @@
+/**
+ * Key edge jitter check: sends the same buffered text through the unmodified firmware with different
+ * main loop costs and checks that the key line edges do not depend on loop() at all.
+ *
+ * Usage: edge_jitter [-w wpm] [text]
+ *   -w wpm  buffer speed (default 25)
+ *   text    Winkeyer text (default "PARIS PARIS ")
+ *
+ * Loop cost is constant 10 us to 5 ms per iteration, or varies pseudo-randomly within the same range.
+ * Marks and spaces of every run are compared with the run at 10 us: with elements switched by timer
+ * interrupt they must be identical to the microsecond, and every one must be a whole number of units
+ * (weighting 50, ratio 3:1) within 2 us of rounding. Any difference is reported and
+ * the program exits with status 1. With CONFIG_KEYING_HW_TIMER commented out the same check shows
+ * the drift of the loop-polled timing.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "sim.h"
+#include "config_keying.h"
+
+void setup();
+void loop();
+
+struct Edge
+{
+  unsigned long long us;
+  byte level;
+};
+
+static std::vector<Edge> edges;
+static std::vector<bool> marks; // level of every recorded interval, true = key down
+
+static void onPin(byte pin, byte level, unsigned long long us)
+{
+  if (pin == CONFIG_KEYING_KEYLINE1)
+    edges.push_back({us, level});
+}
+
+static unsigned long nextRandom(unsigned long &seed)
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 16) & 0x7FFF;
+}
+
+/**
+ * Send text with given loop cost, 0 = random cost 10 us to 5 ms
+ * @return durations of marks and spaces between the first and the last key edge
+ */
+static std::vector<unsigned long long> run(int wpm, const char *text, unsigned long loopUs)
+{
+  edges.clear();
+  simBoard.reset();
+  setup();
+  simBoard.setPinListener(onPin);
+  simBoard.hostWrite(0x00); // Host Open
+  simBoard.hostWrite(0x02);
+  simBoard.hostWrite(0x02); // buffer speed
+  simBoard.hostWrite((byte)wpm);
+  for (const char *c = text; *c; c++)
+    simBoard.hostWrite(*c);
+  // 60 units per PARIS, well over the whole text
+  unsigned long long endUs = simBoard.now() + (strlen(text) / 5 + 2) * 60ULL * (1200000UL / wpm);
+  unsigned long seed = 1;
+  while (simBoard.now() < endUs)
+  {
+    while (simBoard.hostAvailable())
+      simBoard.hostRead(); // revision byte and echo are not checked here
+    loop();
+    simBoard.advance(loopUs ? loopUs : 10 + nextRandom(seed) % 4991);
+  }
+  simBoard.setPinListener(0);
+  simBoard.hostWrite(0x0A); // Clear Buffer and Host Close, firmware singletons survive to the next run
+  simBoard.hostWrite(0x00);
+  simBoard.hostWrite(0x03);
+  for (endUs = simBoard.now() + 1000000UL; simBoard.now() < endUs; simBoard.advance(50))
+    loop();
+  std::vector<unsigned long long> durations;
+  marks.clear();
+  for (size_t i = 1; i < edges.size(); i++)
+  {
+    durations.push_back(edges[i].us - edges[i - 1].us);
+    marks.push_back(edges[i - 1].level == HIGH);
+  }
+  return durations;
+}
+
+int main(int argc, char **argv)
+{
+  int wpm = 25;
+  const char *text = "PARIS PARIS ";
+  int argi = 1;
+  if (argi + 1 < argc && strcmp(argv[argi], "-w") == 0)
+  {
+    wpm = atoi(argv[argi + 1]);
+    argi += 2;
+  }
+  if (argi < argc)
+    text = argv[argi];
+  if (wpm < 5 || wpm > 99)
+  {
+    fprintf(stderr, "usage: %s [-w wpm] [text], speed 5 to 99 WPM\n", argv[0]);
+    return 2;
+  }
+  static const unsigned long costs[] = {10, 50, 200, 1000, 1700, 5000, 0};
+  unsigned long unit = 1200000UL / wpm;
+  std::vector<unsigned long long> reference;
+  unsigned long failed = 0;
+  for (byte c = 0; c < sizeof(costs) / sizeof(costs[0]); c++)
+  {
+    std::vector<unsigned long long> d = run(wpm, text, costs[c]);
+    unsigned long differ = 0, untimed = 0;
+    long long worst = 0;
+    if (c == 0)
+      reference = d;
+    for (size_t i = 0; i < d.size(); i++)
+    {
+      bool mark = marks[i];
+      unsigned long long rest = d[i] % unit;
+      if (rest > 2 && unit - rest > 2)
+      {
+        if (untimed < 3)
+          printf("  %s %zu: %.3f ms is off unit grid\n", mark ? "mark" : "space", i / 2, d[i] / 1000.0);
+        untimed++;
+      }
+      long long delta = (i < reference.size()) ? (long long)d[i] - (long long)reference[i] : 0;
+      if (delta != 0)
+      {
+        if (differ < 3)
+          printf("  %s %zu: %.3f ms, %+lld us against 10 us loop\n", mark ? "mark" : "space", i / 2,
+                 d[i] / 1000.0, delta);
+        differ++;
+        if (llabs(delta) > llabs(worst))
+          worst = delta;
+      }
+    }
+    if (d.size() != reference.size())
+      differ++;
+    if (costs[c])
+      printf("loop %5lu us:", costs[c]);
+    else
+      printf("loop  random :");
+    printf(" %4zu edges, %lu differ (worst %+lld us), %lu off unit grid\n", d.size() + 1, differ, worst, untimed);
+    failed += differ + untimed + (d.size() < 20);
+  }
+  printf(failed ? "FAILED\n" : "no loop-induced jitter\n");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,263 @@
+/**
+ * Native micro-benchmark suite: host CPU time per operation of the hot paths of the firmware.
+ *
+ * Usage: perf_suite [-l label] [-r repeats] > perf.json
+ *   -l label    stored in the output, e.g. commit id (default "")
+ *   -r repeats  every benchmark runs this many times and the fastest run is reported (default 5)
+ *
+ * Benchmarks:
+ *   morse_ascii_to_code   MorseEngine::asciiToCode() over the full character set 0x20-0x7F
+ *   morse_decode          MorseEngine::decodeMorse() over every paddle code 1-0x100 and word space
+ *   fifo_push_shift       TextBuffer push + shift, buffer half full
+ *   fifo_1k_push_shift    the same with 1 KB buffer and 16-bit indexes
+ *   parser_byte           WinkeyProtocol::receive() + service() + getNextMorseCode() per byte of a mixed
+ *                         stream of text and commands as logging programs send it
+ *   keyer_tick_mark       KeyingInterface::service() while a buffered mark is in progress
+ *   keyer_tick_space      the same during a buffered space
+ *   keyer_tick_idle       the same with paddles open and nothing to send
+ *   keyer_refill_char     one character expanded into element queue (sendCode of '0', 6 queue entries)
+ *
+ * The firmware runs on the simulated board (native/sim), the simulated clock is not advanced while
+ * timing, so timer interrupts do not fire and every tick stays in its state.
+ * Results are printed as JSON: {"label": ..., "unit": "ns/op", "results": {name: {"ns_per_op", "ops"}}}.
+ * Keyer ticks are checked to stay in their state, otherwise the program exits with status 1.
+ * Compare two runs with scripts/bench_compare.py. Absolute numbers are host numbers, only ratios
+ * between commits measured on the same machine are meaningful.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "sim.h"
+#include "challenger.h"
+#include "morse.h"
+#include "keying.h"
+#include "protocol.h"
+
+void setup();
+
+static volatile unsigned long sink;
+static int repeats = 5;
+static bool firstResult = true;
+
+typedef void (*Benchmark)(unsigned long ops);
+
+/** Time the benchmark, report the fastest of repeated runs */
+static void run(const char *name, Benchmark benchmark, unsigned long ops)
+{
+  double best = 1e30;
+  for (int r = 0; r < repeats; r++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    benchmark(ops);
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count() / ops;
+    if (ns < best)
+      best = ns;
+  }
+  printf("%s\n    \"%s\": {\"ns_per_op\": %.3f, \"ops\": %lu}", firstResult ? "" : ",", name, best, ops);
+  firstResult = false;
+}
+
+/**
+ * Power-on state of the simulated board and firmware. Firmware singletons survive setup(),
+ * so the element left in progress by the previous benchmark is finished first.
+ */
+static void freshBoard()
+{
+  keyer.clearBuffer();
+  for (byte i = 0; i < 3; i++)
+  {
+    simBoard.advance(11000000UL); // longer than any benchmark element, its timer interrupts fire
+    currentTime = halMillis();
+    currentMicros = halMicros();
+    keyer.service(0);
+  }
+  simBoard.reset();
+  setup();
+  currentTime = halMillis();
+  currentMicros = halMicros();
+}
+
+/* ----- morse codec ----- */
+
+static void asciiToCodeBench(unsigned long ops)
+{
+  unsigned long sum = 0;
+  byte ascii = 0x20;
+  for (unsigned long i = 0; i < ops; i++)
+  {
+    sum += morse.asciiToCode(ascii);
+    ascii = (ascii == 0x7F) ? 0x20 : ascii + 1;
+  }
+  sink = sum;
+}
+
+static void decodeBench(unsigned long ops)
+{
+  unsigned long sum = 0;
+  word code = 1;
+  for (unsigned long i = 0; i < ops; i++)
+  {
+    sum += morse.decodeMorse(code);
+    code = (code == 0x100) ? 0xFFFF : (code == 0xFFFF) ? 1 : code + 1;
+  }
+  sink = sum;
+}
+
+/* ----- text buffer ----- */
+
+template <class FIFO>
+static void fifoBench(unsigned long ops)
+{
+  static FIFO fifo;
+  fifo.reset();
+  for (unsigned long i = 0; i < FIFO::LIMIT / 2; i++)
+    fifo.push('A');
+  unsigned long sum = 0;
+  for (unsigned long i = 0; i < ops; i++)
+  {
+    fifo.push((char)i);
+    sum += (byte)fifo.shift();
+  }
+  sink = sum;
+}
+
+/* ----- Winkeyer parser ----- */
+
+static std::vector<byte> stream;
+
+/** Mixed stream: text, speed changes, buffered speed change and PTT, status request, pointer commands */
+static void buildStream()
+{
+  static const byte pattern[] = {
+    'C', 'Q', ' ', 'T', 'E', 'S', 'T', ' ', 'D', 'E', ' ', 'O', 'K', '1', 'R', 'R', ' ',
+    0x02, 28,                 // speed
+    '5', 'N', 'N', ' ', '1', '4', ' ',
+    0x1C, 32, 'T', 'U', 0x1E, // buffered speed change and cancel
+    0x18, 1, '7', '3', 0x18, 0, // buffered PTT
+    0x15,                     // status request
+    0x16, 0x00, 'E', 0x08,    // buffer pointer reset, backspace
+    0x0B, 0x00,               // key immediate off
+    ' '};
+  stream.assign(pattern, pattern + sizeof(pattern));
+}
+
+static void parserBench(unsigned long ops)
+{
+  freshBoard();
+  protocol.receive(0x00, false); // Host Open
+  protocol.receive(0x02, false);
+  protocol.service(keyer.getState());
+  size_t pos = 0;
+  unsigned long sum = 0;
+  for (unsigned long i = 0; i < ops; i++)
+  {
+    protocol.receive(stream[pos], false);
+    pos = (pos + 1 == stream.size()) ? 0 : pos + 1;
+    if ((i & 7) == 7) // serve every 8 bytes, receive ring holds 32
+    {
+      protocol.service(keyer.getState());
+      byte ascii;
+      for (byte k = 0; k < 8; k++)
+        sum += protocol.getNextMorseCode(ascii); // drain text buffer without keying
+    }
+  }
+  sink = sum;
+}
+
+/* ----- keyer service tick ----- */
+
+static bool stateOk = true;
+
+/** Check the state a keyer tick benchmark was supposed to measure */
+static void expectState(const char *name, OnOffEnum key, BusyEnum busy, KeyingSource source)
+{
+  KeyerState state = keyer.getState();
+  if (state.key != key || state.busy != busy || state.source != source)
+  {
+    fprintf(stderr, "%s: keyer left the measured state (key %d, busy %d, source %d)\n",
+            name, state.key, state.busy, state.source);
+    stateOk = false;
+  }
+}
+
+static void tick(unsigned long ops)
+{
+  unsigned long sum = 0;
+  for (unsigned long i = 0; i < ops; i++)
+  {
+    currentMicros++; // one microsecond per tick, elements are 10 s long
+    sum += keyer.service(0).busy;
+  }
+  sink = sum;
+}
+
+static void markTickBench(unsigned long ops)
+{
+  freshBoard();
+  keyer.sendCode(keyerItem(ITEM_KEYDOWN, 10)); // buffered 10 s mark
+  keyer.service(0);
+  tick(ops);
+  expectState("keyer_tick_mark", ON, BUSY, SRC_BUFFER);
+}
+
+static void spaceTickBench(unsigned long ops)
+{
+  freshBoard();
+  keyer.sendCode(keyerItem(ITEM_WAIT, 10)); // buffered 10 s space
+  keyer.service(0);
+  tick(ops);
+  expectState("keyer_tick_space", OFF, BUSY, SRC_BUFFER);
+}
+
+static void idleTickBench(unsigned long ops)
+{
+  freshBoard();
+  tick(ops);
+  expectState("keyer_tick_idle", OFF, READY, SRC_PADDLE);
+}
+
+static void refillBench(unsigned long ops)
+{
+  freshBoard();
+  word code = morse.asciiToCode('0');
+  for (unsigned long i = 0; i < ops; i++)
+  {
+    keyer.clearBuffer();
+    keyer.sendCode(code);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *label = "";
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "-l") == 0)
+      label = argv[i + 1];
+    else if (strcmp(argv[i], "-r") == 0)
+      repeats = atoi(argv[i + 1]);
+    else
+    {
+      fprintf(stderr, "usage: %s [-l label] [-r repeats]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (repeats < 1)
+    repeats = 1;
+  buildStream();
+  printf("{\n  \"label\": \"%s\",\n  \"unit\": \"ns/op\",\n  \"results\": {", label);
+  run("morse_ascii_to_code", asciiToCodeBench, 48000000UL);
+  run("morse_decode", decodeBench, 25700000UL);
+  run("fifo_push_shift", fifoBench<TextBuffer>, 20000000UL);
+  run("fifo_1k_push_shift", fifoBench<CharacterFIFO<1024>>, 20000000UL);
+  run("parser_byte", parserBench, 2000000UL);
+  run("keyer_tick_mark", markTickBench, 1000000UL);
+  run("keyer_tick_space", spaceTickBench, 1000000UL);
+  run("keyer_tick_idle", idleTickBench, 1000000UL);
+  run("keyer_refill_char", refillBench, 2000000UL);
+  printf("\n  }\n}\n");
+  return stateOk ? 0 : 1;
+}
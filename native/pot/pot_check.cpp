@@ -0,0 +1,165 @@
+/**
+ * Speed potentiometer check: feeds ADC conversion results through Potentiometer::conversionComplete()
+ * the way the ADC interrupt delivers them (one conversion per Timer0 overflow, 1.024 ms) and calls
+ * update() as the main loop does.
+ *
+ * Usage: pot_check
+ *
+ * Scenarios:
+ *   sweep        pot turned slowly from end to end and back: every WPM from minimum to maximum is reached
+ *                in order, no step is skipped or repeated, the ends map to minimum and maximum
+ *   border       pot resting exactly on the border of two steps with +-4 LSB of ADC noise for 30 s:
+ *                the speed must not change more than once (hysteresis)
+ *   step         pot jumped from one end to the middle: the speed must settle within 1 s
+ *   range        speed range changed by Winkeyer command 0x05 while the pot rests: the speed follows
+ *                the pot position within the new range at once
+ * Any failure is reported and the program exits with status 1.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include "potentiometer.h"
+
+static const unsigned long CONVERSION_US = 1024; // Timer0 overflow triggers every conversion
+static unsigned long seed = 1;
+static unsigned long nowUs = 0;
+static unsigned failed = 0;
+
+static unsigned long nextRandom()
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 16) & 0x7FFF;
+}
+
+/** One conversion with noise of +-noise LSB, then the main loop */
+static void convert(int adc, int noise = 0)
+{
+  if (noise > 0)
+    adc += (int)(nextRandom() % (2 * noise + 1)) - noise;
+  if (adc < 0)
+    adc = 0;
+  if (adc > POT_FULL_SCALE)
+    adc = POT_FULL_SCALE;
+  Potentiometer::conversionComplete(adc);
+  potentiometer.update();
+  nowUs += CONVERSION_US;
+}
+
+/** Hold the pot at given position for given time */
+static void hold(int adc, unsigned long us, int noise = 0)
+{
+  for (unsigned long t = 0; t < us; t += CONVERSION_US)
+    convert(adc, noise);
+}
+
+static void check(bool ok, const char *scenario, const char *what)
+{
+  printf("%-8s %-56s %s\n", scenario, what, ok ? "OK" : "FAILED");
+  if (!ok)
+    failed++;
+}
+
+/** Slow turn end to end, 10 s each way */
+static void sweep(byte minWpm, byte maxWpm)
+{
+  potentiometer.setMinMax(minWpm, maxWpm);
+  hold(0, 2000000UL);
+  bool ordered = true;
+  int last = potentiometer.getValue();
+  bool startOk = (last == minWpm);
+  for (long adc = 0; adc <= POT_FULL_SCALE; adc++)
+  {
+    hold(adc, 10000000UL / POT_FULL_SCALE);
+    int v = potentiometer.getValue();
+    if (v != last && v != last + 1)
+      ordered = false;
+    last = v;
+  }
+  hold(POT_FULL_SCALE, 2000000UL);
+  bool endOk = (potentiometer.getValue() == maxWpm);
+  last = potentiometer.getValue();
+  for (long adc = POT_FULL_SCALE; adc >= 0; adc--)
+  {
+    hold(adc, 10000000UL / POT_FULL_SCALE);
+    int v = potentiometer.getValue();
+    if (v != last && v != last - 1)
+      ordered = false;
+    last = v;
+  }
+  hold(0, 2000000UL);
+  char what[64];
+  snprintf(what, sizeof(what), "%u-%u WPM: ends map to minimum and maximum", minWpm, maxWpm);
+  check(startOk && endOk && potentiometer.getValue() == minWpm, "sweep", what);
+  snprintf(what, sizeof(what), "%u-%u WPM: every step in order both ways", minWpm, maxWpm);
+  check(ordered, "sweep", what);
+}
+
+/** Pot on the border between two steps, noisy ADC */
+static void border()
+{
+  potentiometer.setMinMax(15, 46);
+  // border between step 10 and 11 of 32 steps
+  int adc = (int)((11UL * (POT_FULL_SCALE + 1)) / 32);
+  hold(adc, 2000000UL, 4);
+  int last = potentiometer.getValue();
+  unsigned changes = 0;
+  for (unsigned long t = 0; t < 30000000UL; t += CONVERSION_US)
+  {
+    convert(adc, 4);
+    if (potentiometer.getValue() != last)
+    {
+      changes++;
+      last = potentiometer.getValue();
+    }
+  }
+  char what[64];
+  snprintf(what, sizeof(what), "30 s on step border, +-4 LSB noise: %u changes", changes);
+  check(changes <= 1, "border", what);
+}
+
+/** Jump from the low end to the middle */
+static void step()
+{
+  potentiometer.setMinMax(15, 46);
+  hold(0, 3000000UL);
+  int adc = POT_FULL_SCALE / 2;
+  unsigned long start = nowUs, settled = 0;
+  int target = 15 + (int)(((unsigned long)adc * 32) / (POT_FULL_SCALE + 1));
+  for (unsigned long t = 0; t < 3000000UL; t += CONVERSION_US)
+  {
+    convert(adc);
+    if (potentiometer.getValue() == target && settled == 0)
+      settled = nowUs - start;
+    if (potentiometer.getValue() != target)
+      settled = 0;
+  }
+  char what[64];
+  snprintf(what, sizeof(what), "end to middle settles to %d WPM in %lu ms", target, settled / 1000);
+  check(settled > 0 && settled <= 1000000UL, "step", what);
+}
+
+/** Range change while the pot rests at three quarters */
+static void range()
+{
+  potentiometer.setMinMax(15, 46);
+  int adc = (POT_FULL_SCALE * 3) / 4;
+  hold(adc, 3000000UL);
+  potentiometer.setMinMax(10, 25);
+  convert(adc);
+  int v = potentiometer.getValue();
+  char what[64];
+  snprintf(what, sizeof(what), "range 15-46 -> 10-25 at 3/4 turn: %d WPM", v);
+  check(v == 10 + (int)(((unsigned long)adc * 16) / (POT_FULL_SCALE + 1)), "range", what);
+}
+
+int main()
+{
+  potentiometer.init();
+  sweep(15, 46);
+  sweep(5, 99);
+  sweep(20, 35);
+  border();
+  step();
+  range();
+  printf(failed ? "FAILED\n" : "potentiometer OK\n");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,685 @@
+/**
+ * Winkeyer session replay: feeds a recorded or synthetic host byte stream with its original timing into the
+ * unmodified firmware on the simulated board and measures how quickly the keyer reacts.
+ *
+ * Usage: session_replay [-l loop_us] [-m gap_ms] [-n exchanges] [-s seed] [-L ms] [-x] [-v] [recording]
+ *   -l loop_us    simulated cost of one loop() iteration in microseconds (default 50)
+ *   -m gap_ms     host pause that ends a message, see underruns (default 1000)
+ *   -n exchanges  length of the synthetic session (default 20), used when no recording is given
+ *   -s seed       seed of the synthetic session (default 1)
+ *   -L ms         fail when any character sent to an idle keyer starts later than this (default: no limit)
+ *   -x            ignore XOFF, replay the bytes at their recorded times (default: host pauses as loggers do)
+ *   -v            print every character and status request
+ *
+ * Recording is a text file, one burst of bytes per line: "<ms> <bytes...>", e.g.
+ *   0     00 02                # Host Open
+ *   12.5  02 1E "CQ TEST "     # speed 30 WPM and text
+ *   +850  15                   # status request 850 ms after the previous line
+ * Time is absolute in milliseconds or relative to the previous line with "+", bytes are hex ("0x" optional)
+ * or quoted ASCII text, "#" starts a comment. Bytes of one line are due at once, the host writes them one
+ * after another at the serial speed the keyer uses and stops while the keyer reports XOFF. The synthetic session is a contest run: Host Open,
+ * CQ and exchange macros with buffered speed changes, type-ahead call signs, status polls every 200 ms,
+ * speed changes, Escape (clear buffer) in the middle of a CQ and one long macro that fills the text buffer.
+ *
+ * Characters are told from commands the way the firmware parser does (parameter counts of protocol.cpp).
+ * The keyer takes characters out of the text buffer in order and echoes each one to the host when its first
+ * element starts (serial echo, kept on), so the echo tells which characters were keyed and which were removed
+ * by clear or backspace.
+ * Key line marks are assigned to the keyed characters in order, the number of marks comes from the morse table.
+ * Marks that start after a clear belong to the characters that arrived after it.
+ *
+ * Report, all latencies from arrival of the byte at the keyer (end of its stop bit):
+ *   start latency   first key-down of a character that arrived while the keyer had nothing to send
+ *   queue latency   first key-down of a character queued behind other text
+ *   status latency  first status byte (0xC0-0xFF) received by the host after status request 0x15;
+ *                   an unsolicited status counts as the response, as it does for loggers, so a request
+ *                   lost by the keyer shows only when no status follows at all
+ *   XOFF            episodes reported by status bit 0: count, total and longest duration
+ *   underruns       key line idle longer than the character (and word) space because the next character
+ *                   of the same message arrived too late; a host pause longer than gap_ms starts a new message
+ *   keyer gaps      the same while the next character was already there, this is a firmware fault
+ * The program exits with status 1 on any keyer gap, unanswered status request or start latency above -L.
+ * Character spaces assume default weighting and ratio; characters after buffered PTT, wait, key down,
+ * merged letters and half spaces are not checked for gaps.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include "sim.h"
+#include "config_keying.h"
+#include "keying.h"
+#include "morse.h"
+
+void setup();
+void loop();
+
+static unsigned long loopUs = 50;
+static double messageGapMs = 1000;
+static bool honourXoff = true;
+static bool verbose = false;
+
+/* ----- host stream ----- */
+
+struct HostByte
+{
+  unsigned long long us; // time the host sends it
+  byte value;
+};
+
+static std::vector<HostByte> stream;
+
+static bool parseError(const char *path, int line, const char *what)
+{
+  fprintf(stderr, "%s:%d: %s\n", path, line, what);
+  return false;
+}
+
+/** Read recording, see the file comment for its format */
+static bool readRecording(const char *path)
+{
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return parseError(path, 0, "cannot open");
+  char text[1024];
+  double ms = 0;
+  bool ok = true;
+  for (int line = 1; ok && fgets(text, sizeof(text), f); line++)
+  {
+    char *p = text;
+    while (*p == ' ' || *p == '\t')
+      p++;
+    if (*p == '#' || *p == '\n' || *p == '\r' || !*p)
+      continue;
+    bool relative = (*p == '+');
+    char *end;
+    double t = strtod(p + relative, &end);
+    if (end == p + relative || t < 0 || (!relative && t < ms))
+    {
+      ok = parseError(path, line, "time missing or going back");
+      break;
+    }
+    ms = relative ? ms + t : t;
+    unsigned long long us = (unsigned long long)(ms * 1000.0 + 0.5);
+    for (p = end; ok;)
+    {
+      while (*p == ' ' || *p == '\t')
+        p++;
+      if (!*p || *p == '#' || *p == '\n' || *p == '\r')
+        break;
+      if (*p == '"')
+      {
+        for (p++; *p && *p != '"' && *p != '\n'; p++)
+          stream.push_back({us, (byte)*p});
+        if (*p++ != '"')
+          ok = parseError(path, line, "unterminated text");
+        continue;
+      }
+      unsigned long value = strtoul(p, &end, 16);
+      if (end == p || value > 0xFF || (*end && !strchr(" \t\r\n#", *end)))
+        ok = parseError(path, line, "bad byte");
+      p = end;
+      stream.push_back({us, (byte)value});
+    }
+  }
+  fclose(f);
+  if (ok && stream.empty())
+    return parseError(path, 0, "no bytes");
+  return ok;
+}
+
+static unsigned long seed = 1;
+
+static unsigned long nextRandom(unsigned long range)
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 16) % range;
+}
+
+static void put(double ms, const char *bytes, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+    stream.push_back({(unsigned long long)(ms * 1000.0), (byte)bytes[i]});
+}
+
+static void put(double ms, const char *text) { put(ms, text, strlen(text)); }
+
+/** Contest run as loggers drive the keyer, deterministic for given seed */
+static void synthesize(unsigned exchanges)
+{
+  static const char *const CALLS[] = {"OK2ABC", "DL1XYZ", "G4AAA", "W1AW", "JA1ZZZ", "UA3QQ", "EA5KK", "S57DX"};
+  put(0, "\x00\x02\x02\x1C", 4); // Host Open, 28 WPM
+  double ms = 500;
+  for (unsigned k = 0; k < exchanges; k++, ms += 16000)
+  {
+    if (k % 5 == 4)
+    {
+      char speed[] = {0x02, (char)(24 + nextRandom(12))};
+      put(ms - 100, speed, 2);
+    }
+    put(ms, "CQ TEST OK1RR ");
+    if (k % 4 == 2)
+      put(ms + 1500, "\x0A", 1); // Escape during CQ
+    // call typed while the station answers, sent as typed: 150 to 650 ms per key stroke
+    const char *call = CALLS[nextRandom(8)];
+    double typed = ms + 7000;
+    for (const char *c = call; *c; c++, typed += 150 + nextRandom(500))
+      put(typed, c, 1);
+    // exchange with buffered speed change for the serial number
+    char number[24];
+    snprintf(number, sizeof(number), " 5NN \x1C%c%u\x1E ", (char)40, 1 + k);
+    put(typed, number);
+    if (k % 6 == 5)
+      put(typed + 300, "\x08", 1); // backspace, usually too late
+  }
+  // long macro fills the text buffer, the host gets XOFF
+  for (int i = 0; i < 28; i++)
+    put(ms, "TEST OK1RR ");
+  // status polls while the session runs
+  for (double poll = 100; poll < ms + 100000; poll += 200)
+    put(poll, "\x15", 1);
+  std::stable_sort(stream.begin(), stream.end(),
+                   [](const HostByte &a, const HostByte &b) { return a.us < b.us; });
+}
+
+/* ----- what the host sent ----- */
+
+/** Keyed item: character of text, merged letter or buffered key down */
+struct Item
+{
+  byte c;
+  bool text;       // text character, echoed by keyer when its keying starts
+  bool checkGap;   // normal character space expected before it
+  unsigned epoch;  // number of buffer clears sent before it
+  unsigned long long sentUs, arrivalUs;
+  double unitUs;   // at speed host set when sending it
+  byte marks;      // key line marks expected
+  byte keyedMarks = 0;
+  unsigned long long keyDownUs = 0, keyUpUs = 0;
+};
+
+static std::vector<Item> items;
+static std::deque<size_t> pending; // sent, not yet taken by keyer
+static std::vector<size_t> taken;  // taken by keyer, in order
+static std::vector<unsigned long long> clears, polls;
+static std::vector<std::pair<unsigned long long, unsigned long long>> immediateKey; // 0x0B on/off, arrival
+
+/** Parameter counts from protocol.cpp, admin commands at offset 0x20 */
+static const byte PARAMETERS[] = {
+  0, 1, 1, 1, 2, 3, 1, 0, 0, 1, 0, 1, 1, 1, 1, 15,
+  1, 1, 1, 0, 1, 0, 1, 1, 1, 1, 1, 2, 1, 1, 0, 0,
+  3, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 0, 255, 1, 1, 0, 0, 0};
+
+/** Host side Winkeyer parser, tracks speed and classifies every byte sent */
+class HostParser
+{
+  byte command = 0;
+  int remaining = 0;
+  byte param[16];
+  byte count = 0;
+  bool admin = false;
+  int wpm = 20, bufferedWpm = 0;
+  bool irregular = false; // next item does not follow a normal character space
+
+  void addItem(byte c, bool text, unsigned long long sentUs, unsigned long long arrivalUs)
+  {
+    Item item;
+    item.c = c;
+    item.text = text;
+    item.checkGap = !irregular;
+    item.epoch = clears.size();
+    item.sentUs = sentUs;
+    item.arrivalUs = arrivalUs;
+    item.unitUs = 1200000.0 / (bufferedWpm ? bufferedWpm : wpm);
+    item.marks = 0;
+    word code = (c == ' ' || c == '|') ? 0 : morse.asciiToCode(c);
+    for (word bit = 1; code && bit < 0x100; bit <<= 1)
+      if (code & bit)
+      {
+        item.marks = (code == MORSE_SPACE) ? 0 : 7 - __builtin_ctz(bit);
+        break;
+      }
+    if (!text)
+      item.marks = (c == 0) ? 1 : item.marks; // buffered key down is one mark
+    irregular = (c == '|' || !text);
+    items.push_back(item);
+    pending.push_back(items.size() - 1);
+  }
+
+  void execute(unsigned long long sentUs, unsigned long long arrivalUs)
+  {
+    switch (command)
+    {
+    case 0x02:
+      if (param[0] >= 5 && param[0] <= 99)
+        wpm = param[0];
+      break;
+    case 0x0A:
+      clears.push_back(arrivalUs);
+      bufferedWpm = 0;
+      irregular = false;
+      break;
+    case 0x0B:
+      if (param[0])
+        immediateKey.push_back({arrivalUs, ~0ULL});
+      else if (!immediateKey.empty() && immediateKey.back().second == ~0ULL)
+        immediateKey.back().second = arrivalUs;
+      break;
+    case 0x15:
+      polls.push_back(arrivalUs);
+      break;
+    case 0x18:
+    case 0x1A:
+      irregular = true;
+      break;
+    case 0x19:
+      addItem(0, false, sentUs, arrivalUs);
+      break;
+    case 0x1B: // first letter is merged, the second one stays in the buffer as text
+      addItem(param[0], false, sentUs, arrivalUs);
+      addItem(param[1], true, sentUs, arrivalUs);
+      break;
+    case 0x1C:
+      bufferedWpm = (param[0] >= 5 && param[0] <= 99) ? param[0] : 0;
+      break;
+    case 0x1E:
+      bufferedWpm = 0;
+      break;
+    }
+  }
+
+public:
+  /** Byte to be sent; keeps serial echo on, the replay depends on it */
+  byte prepare(byte b)
+  {
+    if (remaining > 0 && count == 0 && !admin && (command == 0x0E || command == 0x0F))
+      return b | 4;
+    return b;
+  }
+
+  void sent(byte b, unsigned long long sentUs, unsigned long long arrivalUs)
+  {
+    if (admin)
+    {
+      admin = false;
+      command = 0x20 + b;
+      remaining = (command < sizeof(PARAMETERS)) ? PARAMETERS[command] : 0;
+      if (remaining == 255)
+        remaining++; // load EEPROM, 256 bytes
+      count = 0;
+    }
+    else if (remaining > 0)
+    {
+      if (count < sizeof(param))
+        param[count++] = b;
+      remaining--;
+      if (command == 0x16 && count == 1 && b >= 1 && b <= 3)
+        remaining++; // pointer command with value
+      if (remaining > 0)
+        return;
+    }
+    else if (b == 0x00)
+    {
+      admin = true;
+      return;
+    }
+    else if (b < 0x20)
+    {
+      command = b;
+      remaining = PARAMETERS[command];
+      count = 0;
+      if (remaining > 0)
+        return;
+    }
+    else
+    {
+      addItem(b, true, sentUs, arrivalUs);
+      return;
+    }
+    execute(sentUs, arrivalUs);
+    command = 0;
+  }
+};
+
+/**
+ * Serial echo of a character keyed by keyer. Characters sent before it and not echoed were removed
+ * by clear or backspace, merged letters and key downs in front of it were taken with it.
+ * Echo of the last character keyed before a clear may still be on its way, later on the characters
+ * sent before the clear are gone and the same letter sent after it must not be mistaken for them.
+ */
+static void echoed(byte c, unsigned long long us)
+{
+  const unsigned long long ECHO_US = 50000; // a few bytes queued for transmission at 1200 Bd
+  while (!pending.empty() && items[pending.front()].epoch < clears.size() &&
+         clears[items[pending.front()].epoch] + ECHO_US < us)
+    pending.pop_front();
+  for (auto i = pending.begin(); i != pending.end(); i++)
+  {
+    if (!items[*i].text || items[*i].c != c)
+      continue;
+    for (auto j = pending.begin(); j != i; j++)
+      if (!items[*j].text)
+        taken.push_back(*j);
+    taken.push_back(*i);
+    pending.erase(pending.begin(), i + 1);
+    return;
+  }
+}
+
+/* ----- what the keyer did ----- */
+
+struct Mark
+{
+  unsigned long long on, off;
+};
+
+struct Status
+{
+  unsigned long long us;
+  byte value;
+};
+
+static std::vector<Mark> marks;
+static std::vector<Status> statuses;
+
+static void onPin(byte pin, byte level, unsigned long long us)
+{
+  if (pin != CONFIG_KEYING_KEYLINE1)
+    return;
+  if (level == HIGH)
+    marks.push_back({us, 0});
+  else if (!marks.empty() && marks.back().off == 0)
+    marks.back().off = us;
+}
+
+/* ----- replay ----- */
+
+static double wallSeconds;
+
+static void replay()
+{
+  HostParser parser;
+  simBoard.reset();
+  setup();
+  simBoard.setPinListener(onPin);
+  auto start = std::chrono::steady_clock::now();
+  size_t next = 0;
+  unsigned long long shiftUs = simBoard.now(); // stream starts when setup() is done
+  unsigned long long pausedUs = 0, lastUs = 0, wireUs = 0;
+  bool xoff = false;
+  while (true)
+  {
+    unsigned long long now = simBoard.now();
+    // like UART without FIFO: next byte is written when the line gets free, so XOFF stops the host at once
+    if (next < stream.size() && !xoff && stream[next].us + shiftUs <= now && wireUs <= now + loopUs)
+    {
+      byte b = parser.prepare(stream[next].value);
+      wireUs = simBoard.hostWrite(b);
+      parser.sent(b, now, wireUs);
+      next++;
+    }
+    loop();
+    simBoard.advance(loopUs);
+    while (simBoard.hostAvailable())
+    {
+      SimSerialByte r = simBoard.hostRead();
+      if ((r.value & 0xC0) == 0xC0)
+      {
+        statuses.push_back({r.us, r.value});
+        if (honourXoff && (r.value & 1) != xoff)
+        {
+          xoff = r.value & 1;
+          if (xoff)
+            pausedUs = r.us;
+          else
+            shiftUs += r.us - pausedUs;
+        }
+      }
+      else if (r.value >= 0x20 && r.value < 0x80)
+        echoed(r.value, r.us);
+    }
+    if (!marks.empty())
+      lastUs = std::max(lastUs, marks.back().off ? marks.back().off : now);
+    if (next == stream.size())
+    {
+      lastUs = std::max(lastUs, stream.back().us + shiftUs);
+      if (now > lastUs + 3000000ULL && keyer.getState().busy == READY)
+        break;
+    }
+  }
+  simBoard.setPinListener(0);
+  wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** Marks of every epoch (between buffer clears) go to the items taken in that epoch, in order */
+static void assignMarks()
+{
+  const unsigned long long CLEAR_US = 1000; // clear is executed by the next loop iteration
+  std::vector<std::deque<size_t>> epochs(clears.size() + 1);
+  for (size_t i : taken)
+    if (items[i].marks > 0)
+      epochs[items[i].epoch].push_back(i);
+  size_t tune = 0;
+  for (const Mark &m : marks)
+  {
+    while (tune < immediateKey.size() && immediateKey[tune].second + CLEAR_US < m.on)
+      tune++;
+    if (tune < immediateKey.size() && immediateKey[tune].first <= m.on)
+      continue; // key immediate from host, not text
+    size_t e = std::upper_bound(clears.begin(), clears.end(), m.on - CLEAR_US) - clears.begin();
+    std::deque<size_t> &queue = epochs[e];
+    while (!queue.empty() && items[queue.front()].keyedMarks == items[queue.front()].marks)
+      queue.pop_front();
+    if (queue.empty())
+      continue;
+    Item &item = items[queue.front()];
+    if (item.keyedMarks++ == 0)
+      item.keyDownUs = m.on;
+    item.keyUpUs = m.off;
+  }
+}
+
+/* ----- report ----- */
+
+struct Distribution
+{
+  const char *name;
+  std::vector<double> ms;
+
+  double percentile(double p)
+  {
+    std::sort(ms.begin(), ms.end());
+    return ms[std::min(ms.size() - 1, (size_t)(p * ms.size()))];
+  }
+
+  void print()
+  {
+    if (ms.empty())
+    {
+      printf("%-32s      0\n", name);
+      return;
+    }
+    double sum = 0;
+    for (double v : ms)
+      sum += v;
+    double p50 = percentile(0.5); // sorts
+    printf("%-32s %6zu  mean %7.2f  p50 %7.2f  p95 %7.2f  max %7.2f ms\n",
+           name, ms.size(), sum / ms.size(), p50, percentile(0.95), ms.back());
+  }
+};
+
+static double ms(unsigned long long us) { return us / 1000.0; }
+
+int main(int argc, char **argv)
+{
+  unsigned exchanges = 20;
+  double limitMs = 0;
+  const char *path = 0;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-v") == 0)
+      verbose = true;
+    else if (strcmp(argv[i], "-x") == 0)
+      honourXoff = false;
+    else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+      loopUs = strtoul(argv[++i], 0, 10);
+    else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+      messageGapMs = atof(argv[++i]);
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      exchanges = strtoul(argv[++i], 0, 10);
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+      seed = strtoul(argv[++i], 0, 10);
+    else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc)
+      limitMs = atof(argv[++i]);
+    else if (argv[i][0] != '-' && !path)
+      path = argv[i];
+    else
+    {
+      fprintf(stderr, "usage: %s [-l loop_us] [-m gap_ms] [-n exchanges] [-s seed] [-L ms] [-x] [-v] [recording]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (loopUs == 0 || (!path && exchanges == 0))
+  {
+    fprintf(stderr, "loop time and number of exchanges must be positive\n");
+    return 2;
+  }
+  if (path)
+  {
+    if (!readRecording(path))
+      return 2;
+  }
+  else
+    synthesize(exchanges);
+  replay();
+  assignMarks();
+
+  // characters
+  Distribution startLatency{"start latency (keyer idle)", {}}, queueLatency{"queue latency (behind text)", {}};
+  Distribution statusLatency{"status latency (0x15)", {}};
+  unsigned long characters = 0, keyed = 0, underruns = 0, gaps = 0;
+  double holeMs = 0, longestHoleMs = 0, longestGapMs = 0;
+  const Item *previous = 0;
+  byte spaces = 0;
+  for (size_t n = 0; n < taken.size(); n++)
+  {
+    const Item &item = items[taken[n]];
+    if (previous && item.epoch != previous->epoch)
+      previous = 0;
+    if (item.c == ' ')
+      spaces++;
+    if (item.marks == 0 || !item.text)
+    {
+      if (item.keyedMarks == item.marks && item.marks > 0)
+        previous = &item, spaces = 0;
+      continue;
+    }
+    if (item.keyedMarks < item.marks)
+      continue; // cut by clear
+    double latency = ms(item.keyDownUs - item.arrivalUs);
+    const char *what = "idle";
+    double late = 0;
+    if (!previous)
+      startLatency.ms.push_back(latency);
+    else
+    {
+      double unit = std::max(previous->unitUs, item.unitUs);
+      double expectedUs = previous->keyUpUs + unit * (3 + 4 * spaces); // element space + character space
+      bool idle = item.arrivalUs >= (item.checkGap ? expectedUs : previous->keyUpUs);
+      (idle ? startLatency : queueLatency).ms.push_back(latency);
+      what = idle ? "idle" : "queued";
+      late = (item.keyDownUs - expectedUs) / 1000.0;
+      if (item.checkGap && item.keyDownUs > expectedUs + std::max(1000.0, unit / 2))
+      {
+        if (!idle)
+        {
+          gaps++;
+          longestGapMs = std::max(longestGapMs, late);
+          what = "KEYER GAP";
+        }
+        else if (ms(item.sentUs - previous->sentUs) <= messageGapMs)
+        {
+          underruns++;
+          holeMs += late;
+          longestHoleMs = std::max(longestHoleMs, late);
+          what = "underrun";
+        }
+      }
+    }
+    if (verbose)
+      printf("%10.3f s  '%c'  key down after %7.2f ms  %s", item.arrivalUs / 1e6, item.c, latency, what);
+    if (verbose && late > 0 && strcmp(what, "queued") && strcmp(what, "idle"))
+      printf(" %.1f ms", late);
+    if (verbose)
+      printf("\n");
+    previous = &item;
+    spaces = 0;
+  }
+  for (const Item &item : items)
+    if (item.text && item.marks > 0)
+    {
+      characters++;
+      keyed += (item.keyedMarks == item.marks);
+    }
+
+  // status requests
+  unsigned long unanswered = 0;
+  size_t s = 0;
+  for (unsigned long long poll : polls)
+  {
+    while (s < statuses.size() && statuses[s].us < poll)
+      s++;
+    if (s == statuses.size())
+    {
+      unanswered++;
+      continue;
+    }
+    statusLatency.ms.push_back(ms(statuses[s].us - poll));
+    if (verbose)
+      printf("%10.3f s  0x15  status 0x%02X after %7.2f ms\n", poll / 1e6, statuses[s].value, ms(statuses[s].us - poll));
+  }
+
+  // XOFF episodes
+  unsigned long episodes = 0;
+  double xoffMs = 0, longestXoffMs = 0;
+  unsigned long long xoffUs = 0;
+  for (const Status &status : statuses)
+  {
+    bool on = status.value & 1;
+    if (on && !xoffUs)
+    {
+      xoffUs = status.us;
+      episodes++;
+    }
+    else if (!on && xoffUs)
+    {
+      xoffMs += ms(status.us - xoffUs);
+      longestXoffMs = std::max(longestXoffMs, ms(status.us - xoffUs));
+      xoffUs = 0;
+    }
+  }
+
+  double simulated = simBoard.now() / 1e6;
+  printf("%zu bytes, %.1f s simulated in %.2f s (%.0fx real time), loop %lu us, host %s XOFF\n",
+         stream.size(), simulated, wallSeconds, simulated / std::max(wallSeconds, 1e-6), loopUs,
+         honourXoff ? "honours" : "ignores");
+  printf("characters %lu, keyed %lu, removed by clear or backspace %lu\n", characters, keyed, characters - keyed);
+  startLatency.print();
+  queueLatency.print();
+  statusLatency.print();
+  printf("%-32s %6lu unanswered\n", "status requests", unanswered);
+  printf("%-32s %6lu  total %9.1f ms  longest %8.1f ms%s\n", "XOFF episodes", episodes, xoffMs, longestXoffMs,
+         xoffUs ? " (still on)" : "");
+  printf("%-32s %6lu  total %9.1f ms  longest %8.1f ms\n", "underruns (host late)", underruns, holeMs, longestHoleMs);
+  printf("%-32s %6lu  longest %8.1f ms\n", "keyer gaps (text was there)", gaps, longestGapMs);
+  bool slow = limitMs > 0 && !startLatency.ms.empty() && startLatency.percentile(1.0) > limitMs;
+  if (slow)
+    printf("start latency above %.2f ms\n", limitMs);
+  bool failed = gaps || unanswered || slow;
+  printf(failed ? "FAILED\n" : "ok\n");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+/**
+ * Native simulation runner: runs the unmodified setup() and loop() of the keyer on the simulated board.
+ *
+ * Usage: challenger [-w wpm] [-h lpm100] [-s seconds] [-l loop_us] [-p 1] [-b baud] [-a baud] [text ...]
+ *   -w wpm      set buffer speed by Winkeyer command 0x02 (default: keep firmware default)
+ *   -h lpm100   set HSCW speed in hundreds of letters per minute by Winkeyer command 0x0C
+ *   -s seconds  simulated time to run (default 10 s)
+ *   -l loop_us  simulated cost of one loop() iteration in microseconds (default 50 us)
+ *   -p 1        print loop profiler histograms at the end (simulated time: only stalls are visible)
+ *   -b baud     after Host Open switch link to WK3 high baud rate by admin command <00><12>
+ *               (baud must be SERIAL_SPEED_HIGH)
+ *   -a baud     host uses this baud rate from the start, keyer has to detect it (CONFIG_PROTOCOL_AUTOBAUD)
+ *   text        sent to the keyer as Winkeyer text after Host Open; \xNN sends raw byte NN (hex),
+ *               e.g. buffered speed change: "\x1C\x0AQRS"
+ *
+ * Every key line and sidetone transition is printed to stdout with its simulated timestamp,
+ * a summary with simulated vs. wall clock time and Echo Test command round trip time is printed to stderr.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sim.h"
+#include "config_keying.h"
+#include "profiler.h"
+#include "tx_scheduler.h"
+#include "config_protocol.h"
+
+void setup();
+void loop();
+
+static void onPin(byte pin, byte level, unsigned long long us)
+{
+  if (pin == CONFIG_KEYING_KEYLINE1)
+    printf("%12.3f ms KEY %s\n", us / 1000.0, level ? "DOWN" : "UP");
+  else if (pin == CONFIG_KEYING_PTTLINE1)
+    printf("%12.3f ms PTT %s\n", us / 1000.0, level ? "ON" : "OFF");
+}
+
+static void onTone(byte, word hz, unsigned long long us)
+{
+  printf("%12.3f ms TONE %u Hz\n", us / 1000.0, hz);
+}
+
+static void printProfile()
+{
+#if defined(CONFIG_LOOP_PROFILER)
+  static const char *names[PROF_SECTIONS] = {"loop", "speed", "paddle", "keyer", "protocol", "fetch", "decode"};
+  fprintf(stderr, "%-9s %6s", "section", "max us");
+  for (byte b = 0; b < PROF_BUCKETS; b++)
+    fprintf(stderr, " <%6u", 4U << b);
+  fprintf(stderr, "\n");
+  for (byte s = 0; s < PROF_SECTIONS; s++)
+  {
+    const LatencyHistogram &h = profiler.getHistogram((ProfiledSection)s);
+    fprintf(stderr, "%-9s %6u", names[s], h.max);
+    for (byte b = 0; b < PROF_BUCKETS; b++)
+      fprintf(stderr, " %7u", h.count[b]);
+    fprintf(stderr, "\n");
+  }
+  fprintf(stderr, "deadline %u us, overruns %u\n", profiler.getDeadline(), profiler.getOverruns());
+#endif
+}
+
+static unsigned long loopUs = 50;
+static unsigned long long loops = 0;
+
+/**
+ * Run event loop on simulated board until given simulated time
+ */
+static void runUntil(unsigned long long endUs)
+{
+  while (simBoard.now() < endUs)
+  {
+    loop();
+    simBoard.advance(loopUs);
+    loops++;
+    if (simBoard.isRebootRequested())
+      setup();
+  }
+}
+
+/**
+ * Run event loop until host receives expected byte or timeout expires
+ * @return time of arrival, zero on timeout
+ */
+static unsigned long long waitForByte(byte expected, unsigned long timeoutUs)
+{
+  unsigned long long endUs = simBoard.now() + timeoutUs;
+  while (simBoard.now() < endUs)
+  {
+    runUntil(simBoard.now() + loopUs);
+    while (simBoard.hostAvailable())
+    {
+      SimSerialByte b = simBoard.hostRead();
+      if (b.value == expected && b.baud == simBoard.hostBaud())
+        return b.us;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Host Open, repeated up to three times when there is no answer, as logging programs do
+ * @return true if keyer answered with its revision
+ */
+static bool hostOpen()
+{
+  for (byte attempt = 0; attempt < 3; attempt++)
+  {
+    simBoard.hostWrite(0x00);
+    simBoard.hostWrite(0x02);
+    if (waitForByte(22, 200000UL))
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Admin command Echo Test: time from the host starting to send the command to the echoed byte arriving
+ * @return round trip time in microseconds, zero on timeout
+ */
+static unsigned long echoRoundTrip()
+{
+  unsigned long long start = simBoard.now();
+  simBoard.hostWrite(0x00);
+  simBoard.hostWrite(0x04);
+  simBoard.hostWrite('U');
+  unsigned long long end = waitForByte('U', 1000000UL);
+  return end ? (unsigned long)(end - start) : 0;
+}
+
+static double wallSeconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+  int wpm = 0;
+  int hscw = 0;
+  double seconds = 10.0;
+  bool showProfile = false;
+  unsigned long highBaud = 0;
+  unsigned long hostBaud = 0;
+  int argi = 1;
+  for (; argi < argc && argv[argi][0] == '-' && argi + 1 < argc; argi += 2)
+  {
+    if (strcmp(argv[argi], "-w") == 0)
+      wpm = atoi(argv[argi + 1]);
+    else if (strcmp(argv[argi], "-h") == 0)
+      hscw = atoi(argv[argi + 1]);
+    else if (strcmp(argv[argi], "-s") == 0)
+      seconds = atof(argv[argi + 1]);
+    else if (strcmp(argv[argi], "-l") == 0)
+      loopUs = strtoul(argv[argi + 1], 0, 10);
+    else if (strcmp(argv[argi], "-p") == 0)
+      showProfile = atoi(argv[argi + 1]) != 0;
+    else if (strcmp(argv[argi], "-b") == 0)
+      highBaud = strtoul(argv[argi + 1], 0, 10);
+    else if (strcmp(argv[argi], "-a") == 0)
+      hostBaud = strtoul(argv[argi + 1], 0, 10);
+    else
+    {
+      fprintf(stderr, "usage: %s [-w wpm] [-h lpm100] [-s seconds] [-l loop_us] [-p 1] [-b baud] [-a baud] [text ...]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (loopUs == 0)
+    loopUs = 1;
+  if (highBaud && highBaud != SERIAL_SPEED_HIGH)
+  {
+    fprintf(stderr, "only %lu baud can be negotiated\n", SERIAL_SPEED_HIGH);
+    return 2;
+  }
+
+  simBoard.reset();
+  setup();
+  simBoard.setPinListener(onPin);
+  simBoard.setToneListener(onTone);
+
+  // host open, optional baud rate change and speed, then text
+  double wallStart = wallSeconds();
+  simBoard.hostSetBaud(hostBaud);
+  if (!hostOpen())
+    fprintf(stderr, "no answer to Host Open\n");
+  if (highBaud)
+  {
+    simBoard.hostWrite(0x00);
+    simBoard.hostWrite(0x12);
+    runUntil(simBoard.now() + 20000UL); // command is sent and executed
+    simBoard.hostSetBaud(highBaud);
+  }
+  unsigned long echoUs = echoRoundTrip();
+  if (wpm > 0)
+  {
+    simBoard.hostWrite(0x02);
+    simBoard.hostWrite((byte)wpm);
+  }
+  if (hscw > 0)
+  {
+    simBoard.hostWrite(0x0C);
+    simBoard.hostWrite((byte)hscw);
+  }
+  for (int i = argi; i < argc; i++)
+  {
+    if (i > argi)
+      simBoard.hostWrite(' ');
+    for (const char *p = argv[i]; *p; p++)
+    {
+      if (p[0] == '\\' && p[1] == 'x' && p[2] && p[3])
+      {
+        char hex[3] = {p[2], p[3], 0};
+        simBoard.hostWrite((byte)strtoul(hex, 0, 16));
+        p += 3;
+      }
+      else
+        simBoard.hostWrite((byte)*p);
+    }
+  }
+
+  runUntil(simBoard.now() + (unsigned long long)(seconds * 1e6));
+  double wall = wallSeconds() - wallStart;
+  unsigned long received = 0;
+  while (simBoard.hostAvailable())
+  {
+    simBoard.hostRead(); // responses are not interesting here, only their count
+    received++;
+  }
+  fprintf(stderr, "simulated %.3f s in %.3f s wall time (%.0fx real time), %llu loop iterations\n",
+          seconds, wall, (wall > 0) ? seconds / wall : 0.0, loops);
+  fprintf(stderr, "serial: %lu bytes received by host, dropped %u priority, %u bulk\n",
+          received, txScheduler.getDropped(TX_PRIORITY), txScheduler.getDropped(TX_BULK));
+  fprintf(stderr, "echo test round trip: %.3f ms\n", echoUs / 1000.0);
+  fprintf(stderr, "idle sleep: %.1f %% of simulated time\n",
+          simBoard.now() ? 100.0 * simBoard.getSleptUs() / simBoard.now() : 0.0);
+  if (showProfile)
+    printProfile();
+  return 0;
+}
\ No newline at end of file
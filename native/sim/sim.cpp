@@ -0,0 +1,401 @@
+/**
+ * Board simulator and HAL implementation for the native host build
+ **/
+#include "sim.h"
+#include "hal.h"
+
+SimBoard simBoard;
+
+SimBoard::SimBoard() { eraseEeprom(); }
+
+/**
+ * Bring simulated board to power-on state: time zero, all pins inputs with pull-up level (paddles open)
+ */
+void SimBoard::reset()
+{
+  nowUs = 0;
+  for (byte i = 0; i < PIN_COUNT; i++)
+  {
+    level[i] = HIGH;
+    mode[i] = INPUT;
+  }
+  toneHz = 0;
+  toneByInterrupt = false;
+  toneSinceUs = 0;
+  toneHalfPeriodsE6 = 0;
+  memset(interrupts, 0, sizeof(interrupts));
+  encoderSteps = 0;
+  rebootFlag = false;
+  baudRate = 0;
+  hostBaudRate = 0;
+  rxWireFreeUs = 0;
+  txWireFreeUs = 0;
+  rxWire.clear();
+  txWire.clear();
+  hostInput.clear();
+  receiver = 0;
+  interruptsEnabled = true;
+  alarmActive = false;
+  alarmHandler = 0;
+  pinChangeHandler = 0;
+  pinChangePending = false;
+  sleptUs = 0;
+  eepromBusyUs = 0;
+}
+
+unsigned long long SimBoard::now() { return nowUs; }
+
+/**
+ * Move simulated clock forward and deliver all serial bytes that became due
+ */
+void SimBoard::advance(unsigned long us)
+{
+  advanceTo(nowUs + us);
+}
+
+/**
+ * Move simulated clock to given time. If a timer alarm is due on the way, the clock stops
+ * at the alarm time and the handler is called as interrupt service routine.
+ */
+void SimBoard::advanceTo(unsigned long long us)
+{
+  while (alarmActive && interruptsEnabled && alarmUs <= us)
+  {
+    if (alarmUs > nowUs)
+      nowUs = alarmUs;
+    updateSerial();
+    alarmActive = false; // one shot, handler may set it again
+    interrupts[SIM_IRQ_ALARM]++;
+    interruptsEnabled = false;
+    alarmHandler();
+    interruptsEnabled = true;
+  }
+  if (us > nowUs)
+    nowUs = us;
+  updateSerial();
+  updatePinChange();
+}
+
+void SimBoard::setAlarm(unsigned long long us, AlarmHandler handler)
+{
+  alarmUs = us;
+  alarmHandler = handler;
+  alarmActive = (handler != 0);
+}
+
+void SimBoard::cancelAlarm() { alarmActive = false; }
+
+/**
+ * Idle sleep: enable interrupts and move the clock to the next interrupt, which is the earliest of
+ * timer alarm, received byte, transmitted byte and millis() timer tick.
+ */
+void SimBoard::idle()
+{
+  unsigned long long wake = (nowUs / MILLIS_TICK_US + 1) * MILLIS_TICK_US;
+  if (alarmActive && alarmUs < wake)
+    wake = alarmUs;
+  if (!rxWire.empty() && rxWire.front().us < wake)
+    wake = rxWire.front().us;
+  if (!txWire.empty() && txWire.front().us < wake)
+    wake = txWire.front().us;
+  if (wake > nowUs)
+    sleptUs += wake - nowUs;
+  setInterrupts(true);
+  advanceTo(wake);
+}
+
+unsigned long long SimBoard::getSleptUs() { return sleptUs; }
+
+/**
+ * Global interrupt enable. Alarm that became due while interrupts were disabled fires immediately
+ * after enabling, i.e. late, as on real hardware.
+ */
+void SimBoard::setInterrupts(bool enabled)
+{
+  interruptsEnabled = enabled;
+  if (enabled)
+    advanceTo(nowUs);
+}
+
+/**
+ * @return time to transfer one 8N1 character (10 bits) at given baud rate
+ */
+unsigned long long SimBoard::byteTimeUs(unsigned long baud)
+{
+  return (baud > 0) ? (10000000ULL + baud - 1) / baud : 0;
+}
+
+/**
+ * Hand received bytes to receiver as interrupt, move sent bytes from TX buffer to host.
+ * Bytes received while interrupts are disabled wait on the wire until they are enabled again.
+ */
+void SimBoard::updateSerial()
+{
+  while (interruptsEnabled && !rxWire.empty() && rxWire.front().us <= nowUs)
+  {
+    SimSerialByte b = rxWire.front();
+    rxWire.pop_front();
+    if (receiver)
+    {
+      interrupts[SIM_IRQ_SERIAL_RX]++;
+      interruptsEnabled = false;
+      receiver(b.value, b.baud != baudRate);
+      interruptsEnabled = true;
+    }
+  }
+  while (!txWire.empty() && txWire.front().us <= nowUs)
+  {
+    hostInput.push_back(txWire.front());
+    txWire.pop_front();
+  }
+}
+
+/**
+ * Input pin change raises pin change interrupt, deferred while interrupts are disabled
+ */
+void SimBoard::setInput(byte pin, byte value)
+{
+  if (pin >= PIN_COUNT || mode[pin] == OUTPUT)
+    return;
+  value = value ? HIGH : LOW;
+  if (level[pin] == value)
+    return;
+  level[pin] = value;
+  pinChangePending = (pinChangeHandler != 0);
+  updatePinChange();
+}
+
+void SimBoard::updatePinChange()
+{
+  if (interruptsEnabled && pinChangePending)
+  {
+    pinChangePending = false;
+    interrupts[SIM_IRQ_PIN_CHANGE]++;
+    interruptsEnabled = false;
+    pinChangeHandler();
+    interruptsEnabled = true;
+  }
+}
+
+void SimBoard::setPinChangeHandler(PinChangeHandler handler) { pinChangeHandler = handler; }
+
+/**
+ * @return interrupt entries of given source since reset(); millis() ticks and tone interrupts are computed
+ * from simulated time, the others are counted as their handlers are called
+ */
+unsigned long long SimBoard::getInterrupts(SimInterrupt source)
+{
+  if (source == SIM_IRQ_MILLIS)
+    return nowUs / MILLIS_TICK_US;
+  if (source == SIM_IRQ_TONE)
+    return (toneHalfPeriodsE6 + (toneByInterrupt ? 2ULL * toneHz * (nowUs - toneSinceUs) : 0)) / 1000000ULL;
+  return (source < SIM_IRQ_SOURCES) ? interrupts[source] : 0;
+}
+
+byte SimBoard::getLevel(byte pin) { return (pin < PIN_COUNT) ? level[pin] : LOW; }
+
+byte SimBoard::getMode(byte pin) { return (pin < PIN_COUNT) ? mode[pin] : INPUT; }
+
+word SimBoard::getTone() { return toneHz; }
+
+void SimBoard::setPinListener(PinListener listener) { pinListener = listener; }
+
+void SimBoard::setToneListener(ToneListener listener) { toneListener = listener; }
+
+void SimBoard::turnEncoder(int steps) { encoderSteps += steps; }
+
+int SimBoard::takeEncoderSteps()
+{
+  int steps = encoderSteps;
+  encoderSteps = 0;
+  return steps;
+}
+
+/**
+ * Host starts sending a byte. It arrives to the keyer one character time later,
+ * or later if the line is still busy with previous bytes.
+ */
+unsigned long long SimBoard::hostWrite(byte b)
+{
+  unsigned long baud = hostBaudRate ? hostBaudRate : baudRate;
+  unsigned long long start = (rxWireFreeUs > nowUs) ? rxWireFreeUs : nowUs;
+  rxWireFreeUs = start + byteTimeUs(baud);
+  rxWire.push_back({rxWireFreeUs, b, baud});
+  return rxWireFreeUs;
+}
+
+void SimBoard::hostSetBaud(unsigned long baud) { hostBaudRate = baud; }
+
+unsigned long SimBoard::hostBaud() { return hostBaudRate ? hostBaudRate : baudRate; }
+
+bool SimBoard::hostAvailable()
+{
+  updateSerial();
+  return !hostInput.empty();
+}
+
+SimSerialByte SimBoard::hostRead()
+{
+  SimSerialByte b = {nowUs, 0, 0};
+  updateSerial();
+  if (!hostInput.empty())
+  {
+    b = hostInput.front();
+    hostInput.pop_front();
+  }
+  return b;
+}
+
+bool SimBoard::isRebootRequested()
+{
+  bool flag = rebootFlag;
+  rebootFlag = false;
+  return flag;
+}
+
+void SimBoard::serialBegin(unsigned long baud, Receiver r)
+{
+  baudRate = baud;
+  receiver = r;
+}
+
+/**
+ * Firmware writes a byte. When TX buffer is full, the write blocks (clock advances)
+ * until the oldest byte leaves the buffer, as the UART driver does.
+ */
+void SimBoard::serialWrite(byte b)
+{
+  updateSerial();
+  if (txWire.size() > SERIAL_BUFFER_SIZE) // buffer + byte being shifted out
+    advanceTo(txWire.front().us);
+  unsigned long long start = (txWireFreeUs > nowUs) ? txWireFreeUs : nowUs;
+  txWireFreeUs = start + byteTimeUs(baudRate);
+  txWire.push_back({txWireFreeUs, b, baudRate});
+  interrupts[SIM_IRQ_SERIAL_TX]++;
+}
+
+/**
+ * Baud rate change applies to bytes written from now on, bytes already on the wire keep their timing
+ */
+void SimBoard::serialSetBaud(unsigned long baud) { baudRate = baud; }
+
+bool SimBoard::serialIsIdle()
+{
+  updateSerial();
+  return txWire.empty();
+}
+
+bool SimBoard::serialCanWrite()
+{
+  updateSerial();
+  return txWire.size() <= SERIAL_BUFFER_SIZE; // serialWrite() would not block
+}
+
+void SimBoard::pinMode(byte pin, byte m)
+{
+  if (pin >= PIN_COUNT)
+    return;
+  mode[pin] = (m == OUTPUT) ? OUTPUT : INPUT;
+  if (m == OUTPUT)
+    level[pin] = LOW;
+  else
+    level[pin] = HIGH; // floating or pulled-up input reads high
+}
+
+void SimBoard::digitalWrite(byte pin, byte value)
+{
+  if (pin >= PIN_COUNT || mode[pin] != OUTPUT)
+    return;
+  value = value ? HIGH : LOW;
+  if (level[pin] != value)
+  {
+    level[pin] = value;
+    if (pinListener)
+      pinListener(pin, value, nowUs);
+  }
+}
+
+int SimBoard::digitalRead(byte pin) { return getLevel(pin); }
+
+/**
+ * Account tone interrupts up to now and switch to new tone
+ */
+void SimBoard::updateTone(word hz, bool byInterrupt)
+{
+  if (toneByInterrupt)
+    toneHalfPeriodsE6 += 2ULL * toneHz * (nowUs - toneSinceUs);
+  toneSinceUs = nowUs;
+  toneByInterrupt = byInterrupt && hz > 0;
+  toneHz = hz;
+}
+
+void SimBoard::tone(byte pin, word hz)
+{
+  if (hz != toneHz || (hz > 0 && !toneByInterrupt))
+  {
+    updateTone(hz, true);
+    if (toneListener)
+      toneListener(pin, hz, nowUs);
+  }
+}
+
+void SimBoard::compareOutput(byte pin, word hz)
+{
+  if (hz != toneHz || toneByInterrupt)
+  {
+    updateTone(hz, false);
+    if (toneListener)
+      toneListener(pin, hz, nowUs);
+  }
+}
+
+void SimBoard::requestReboot() { rebootFlag = true; }
+
+void SimBoard::eraseEeprom()
+{
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  memset(eepromWrites, 0, sizeof(eepromWrites));
+}
+
+byte SimBoard::peekEeprom(word address) { return eeprom[address % EEPROM_SIZE]; }
+
+unsigned long SimBoard::getEepromWrites(word address) { return eepromWrites[address % EEPROM_SIZE]; }
+
+bool SimBoard::eepromReady() { return nowUs >= eepromBusyUs; }
+
+byte SimBoard::eepromRead(word address) { return eeprom[address % EEPROM_SIZE]; }
+
+/**
+ * Write EEPROM byte; like the target, waits for the previous write to finish, then starts this one
+ */
+void SimBoard::eepromWrite(word address, byte value)
+{
+  if (nowUs < eepromBusyUs)
+    advanceTo(eepromBusyUs);
+  eeprom[address % EEPROM_SIZE] = value;
+  eepromWrites[address % EEPROM_SIZE]++;
+  eepromBusyUs = nowUs + EEPROM_WRITE_US;
+}
+
+/* ----- HAL implementation ----- */
+
+void halPinMode(byte pin, byte mode) { simBoard.pinMode(pin, mode); }
+void halDigitalWrite(byte pin, byte level) { simBoard.digitalWrite(pin, level); }
+int halDigitalRead(byte pin) { return simBoard.digitalRead(pin); }
+void halTone(byte pin, word hz) { simBoard.tone(pin, hz); }
+void halNoTone(byte pin) { simBoard.tone(pin, 0); }
+unsigned long halMillis() { return (uint32_t)(simBoard.now() / 1000ULL); } // wraps as on target
+unsigned long halMicros() { return (uint32_t)simBoard.now(); }
+void halDelay(unsigned long ms) { simBoard.advance(ms * 1000UL); }
+void halSerialBegin(unsigned long baud, HalSerialReceiver receiver) { simBoard.serialBegin(baud, receiver); }
+void halSerialWrite(byte b) { simBoard.serialWrite(b); }
+bool halSerialCanWrite() { return simBoard.serialCanWrite(); }
+void halSerialSetBaud(unsigned long baud) { simBoard.serialSetBaud(baud); }
+bool halSerialIsIdle() { return simBoard.serialIsIdle(); }
+void halNoInterrupts() { simBoard.setInterrupts(false); }
+void halInterrupts() { simBoard.setInterrupts(true); }
+void halIdle() { simBoard.idle(); }
+void halReboot() { simBoard.requestReboot(); }
+bool halEepromReady() { return simBoard.eepromReady(); }
+byte halEepromRead(word address) { return simBoard.eepromRead(address); }
+void halEepromWrite(word address, byte value) { simBoard.eepromWrite(address, value); }
\ No newline at end of file
@@ -0,0 +1,165 @@
+#ifndef _SIM_H_
+#define _SIM_H_
+
+/**
+ * Board simulator for the native host build.
+ *
+ * It implements the HAL (hal.h) on top of a simulated clock. The clock never follows wall time,
+ * it only moves when the simulation driver calls advance() (one loop() iteration costs a configured
+ * number of microseconds) or when the firmware waits in halDelay() or in a blocking serial write.
+ * Therefore the event loop runs as fast as the host CPU allows, typically thousands of times
+ * faster than real time, and every run is fully deterministic.
+ *
+ * Timer interrupt is modelled by an alarm: the simulated clock stops exactly at the alarm time and
+ * the handler is called, even when it happens in the middle of loop() (e.g. during blocking serial write).
+ * Idle sleep moves the clock to the next interrupt, including the 1024 us millis() timer tick of the target.
+ * Input pin change raises pin change interrupt (deferred while interrupts are disabled).
+ *
+ * Serial port is modelled at byte level including the baud rate: bytes written by host arrive
+ * one character time apart and each one is handed to the receiver as receive interrupt (deferred while
+ * interrupts are disabled), bytes written by firmware leave one character time apart from a small
+ * TX buffer and the write blocks when the TX buffer is full, exactly like the UART driver does.
+ * Host and keyer baud rates are independent; a byte sent at other baud rate than the receiver uses
+ * is received with framing error (real UART would often see garbage as well).
+ *
+ * Interrupt entries are counted per source. Arduino tone() is modelled as the Timer2 compare interrupt it uses,
+ * which toggles the pin twice per period; a square wave generated by timer compare output costs no interrupt.
+ *
+ * EEPROM content survives reset(), which stands for power cycle; it is erased (0xFF) when the simulator
+ * starts and by eraseEeprom(). A write keeps the EEPROM busy for 3.4 ms as on target, writes are counted
+ * per address so that wear levelling can be checked.
+ */
+
+#include <Arduino.h>
+#include <deque>
+
+/** Interrupt sources counted by the simulator */
+enum SimInterrupt : byte
+{
+  SIM_IRQ_MILLIS = 0,  // Timer0 overflow, millis() tick
+  SIM_IRQ_ALARM,       // timer compare alarm (element timer)
+  SIM_IRQ_TONE,        // Timer2 compare of Arduino tone(), two per period
+  SIM_IRQ_PIN_CHANGE,  // paddle pin change
+  SIM_IRQ_SERIAL_RX,   // byte received
+  SIM_IRQ_SERIAL_TX,   // byte handed to transmitter
+  SIM_IRQ_SOURCES
+};
+
+struct SimSerialByte
+{
+  unsigned long long us; // time of arrival (RX) or time when completely sent (TX)
+  byte value;
+  unsigned long baud;    // baud rate used by sender
+};
+
+class SimBoard
+{
+public:
+  static const byte PIN_COUNT = 22;
+  static const byte SERIAL_BUFFER_SIZE = 4; // same as UART driver TX buffer
+  static const word MILLIS_TICK_US = 1024;  // Arduino millis() timer interrupt period, wakes idle sleep
+  static const word EEPROM_SIZE = 1024;     // ATmega328P
+  static const word EEPROM_WRITE_US = 3400; // byte write time
+
+  typedef void (*PinListener)(byte pin, byte level, unsigned long long us);
+  typedef void (*ToneListener)(byte pin, word hz, unsigned long long us);
+  typedef void (*AlarmHandler)(); // simulated timer compare interrupt
+  typedef void (*Receiver)(byte b, bool framingError); // simulated serial receive interrupt
+  typedef void (*PinChangeHandler)(); // simulated pin change interrupt
+
+private:
+  unsigned long long nowUs = 0;
+  byte level[PIN_COUNT];
+  byte mode[PIN_COUNT];
+  word toneHz = 0;
+  bool toneByInterrupt = false;        // tone() running, as opposed to compare output
+  unsigned long long toneSinceUs = 0;  // time of the last tone change
+  unsigned long long toneHalfPeriodsE6 = 0; // tone interrupts before toneSinceUs, times 1000000
+  unsigned long long interrupts[SIM_IRQ_SOURCES];
+  void updateTone(word hz, bool byInterrupt);
+  int encoderSteps = 0;
+  bool rebootFlag = false;
+  PinListener pinListener = 0;
+  ToneListener toneListener = 0;
+  PinChangeHandler pinChangeHandler = 0;
+  bool pinChangePending = false;
+  void updatePinChange();
+  // timer interrupt model
+  bool interruptsEnabled = true;
+  bool alarmActive = false;
+  unsigned long long alarmUs = 0;
+  AlarmHandler alarmHandler = 0;
+  unsigned long long sleptUs = 0;
+  void advanceTo(unsigned long long us);
+  // serial port model
+  unsigned long baudRate = 0;
+  unsigned long hostBaudRate = 0; // zero = same as keyer
+  unsigned long long rxWireFreeUs = 0; // time when host -> keyer line becomes free
+  unsigned long long txWireFreeUs = 0; // time when keyer -> host line becomes free
+  std::deque<SimSerialByte> rxWire;    // bytes being transmitted by host
+  std::deque<SimSerialByte> txWire;    // bytes waiting in core TX buffer or being transmitted
+  std::deque<SimSerialByte> hostInput; // bytes already received by host
+  Receiver receiver = 0;
+  void updateSerial();
+  static unsigned long long byteTimeUs(unsigned long baud);
+  // EEPROM model
+  byte eeprom[EEPROM_SIZE];
+  unsigned long eepromWrites[EEPROM_SIZE];
+  unsigned long long eepromBusyUs = 0; // time when the write in progress finishes
+
+public:
+  SimBoard();
+  void reset();
+  // time
+  unsigned long long now();          // full 64-bit simulated time in microseconds
+  void advance(unsigned long us);    // move simulated clock forward, fire timer interrupts on their exact time
+  // timer interrupt
+  void setAlarm(unsigned long long us, AlarmHandler handler); // call handler when simulated clock reaches us
+  void cancelAlarm();
+  void setInterrupts(bool enabled);  // global interrupt enable; alarms are deferred while disabled
+  void idle();                       // idle sleep until the next interrupt, enables interrupts
+  unsigned long long getSleptUs();   // total time spent in idle sleep
+  // pins
+  void setInput(byte pin, byte value); // drive input pin from outside world (paddles, buttons)
+  byte getLevel(byte pin);             // read current pin level
+  byte getMode(byte pin);
+  word getTone();
+  void setPinListener(PinListener listener);
+  void setToneListener(ToneListener listener);
+  void setPinChangeHandler(PinChangeHandler handler); // called as interrupt when an input pin changes
+  // interrupt load
+  unsigned long long getInterrupts(SimInterrupt source); // interrupt entries since reset()
+  // speed control stand-in
+  void turnEncoder(int steps);
+  int takeEncoderSteps();
+  // serial port, host side
+  void hostSetBaud(unsigned long baud); // zero = follow keyer baud rate
+  unsigned long hostBaud();             // baud rate host uses now
+  unsigned long long hostWrite(byte b); // start sending byte to keyer, returns time of its arrival
+  bool hostAvailable();            // true if a byte from keyer was received by host
+  SimSerialByte hostRead();        // read byte received from keyer including its timestamp
+  bool isRebootRequested();
+  // EEPROM, outside world view
+  void eraseEeprom();                      // new chip: all bytes 0xFF, write counters cleared
+  byte peekEeprom(word address);
+  unsigned long getEepromWrites(word address); // number of writes to address since eraseEeprom()
+  // serial port and system, firmware side (used by HAL implementation)
+  void serialBegin(unsigned long baud, Receiver r);
+  void serialSetBaud(unsigned long baud);
+  bool serialIsIdle();
+  void serialWrite(byte b);
+  bool serialCanWrite();
+  void pinMode(byte pin, byte m);
+  void digitalWrite(byte pin, byte value);
+  int digitalRead(byte pin);
+  void tone(byte pin, word hz);          // Arduino tone(), zero = noTone()
+  void compareOutput(byte pin, word hz); // square wave toggled by timer compare hardware, zero = off
+  void requestReboot();
+  bool eepromReady();
+  byte eepromRead(word address);
+  void eepromWrite(word address, byte value);
+};
+
+extern SimBoard simBoard;
+
+#endif
\ No newline at end of file
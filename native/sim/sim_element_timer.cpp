@@ -0,0 +1,34 @@
+/**
+ * Element timer for the native host build: Timer1 compare match is modelled by the simulator alarm,
+ * which fires exactly at the programmed simulated time, also in the middle of a loop() iteration.
+ **/
+#include "element_timer.h"
+#include "sim.h"
+
+ElementTimer elementTimer;
+
+static ElementTimer::Handler deadlineHandler = 0;
+static unsigned long long deadline = 0;
+
+void ElementTimer::init(Handler handler)
+{
+  deadlineHandler = handler;
+  simBoard.cancelAlarm();
+}
+
+void ElementTimer::start(unsigned long us)
+{
+  deadline = simBoard.now() + us;
+  simBoard.setAlarm(deadline, deadlineHandler);
+}
+
+void ElementTimer::next(unsigned long us)
+{
+  deadline += us;
+  simBoard.setAlarm(deadline, deadlineHandler);
+}
+
+void ElementTimer::stop()
+{
+  simBoard.cancelAlarm();
+}
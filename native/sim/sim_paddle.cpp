@@ -0,0 +1,13 @@
+/**
+ * Paddle pin change interrupt for the native host build: paddle contacts are driven by
+ * simulation driver through simBoard.setInput(), which calls the handler as interrupt.
+ **/
+#include "paddle.h"
+#include "sim.h"
+
+static void onPaddleChange() { paddle.pinChange(); }
+
+void PaddleInterface::enableInterrupt()
+{
+  simBoard.setPinChangeHandler(onPaddleChange);
+}
@@ -0,0 +1,10 @@
+/**
+ * Speed potentiometer ADC for the native host build: there are no ADC registers, conversion
+ * results are injected by simulation driver, which calls Potentiometer::conversionComplete()
+ * as the conversion complete interrupt.
+ **/
+#include "potentiometer.h"
+
+#if defined(CONFIG_SPEED_TYPE_POTENTIOMETER)
+void Potentiometer::enableInterrupt() {}
+#endif
@@ -0,0 +1,31 @@
+/**
+ * Rotary encoder stand-in for the native host build.
+ * The real driver (src/rotary_encoder.cpp) is interrupt and register based, here the steps
+ * are injected by simulation driver through simBoard.turnEncoder().
+ **/
+#include "rotary_encoder.h"
+#include "sim.h"
+
+RotaryEncoder encoder;
+
+void RotaryEncoder::init() {}
+
+int RotaryEncoder::cropValue(int v)
+{
+  if (v < minValue) return minValue;
+  if (v > maxValue) return maxValue;
+  return v;
+}
+
+void RotaryEncoder::setValue(int v) { value = cropValue(v); }
+
+void RotaryEncoder::update()
+{
+  valueIncrement = simBoard.takeEncoderSteps();
+  if (valueIncrement != 0)
+    value = cropValue(value + valueIncrement);
+}
+
+void RotaryEncoder::enableInterrupt() {}
+
+void RotaryEncoder::disableInterrupt() {}
\ No newline at end of file
@@ -0,0 +1,32 @@
+/**
+ * Sidetone for the native host build: the square wave is only reported to the simulator as frequency,
+ * as Timer2 compare output on its output compare pins (no interrupts) or as Arduino tone() otherwise.
+ **/
+#include "sidetone.h"
+#include "hal.h"
+#include "sim.h"
+
+Sidetone sidetone;
+
+void Sidetone::init()
+{
+  halPinMode(CONFIG_KEYING_SIDETONE, OUTPUT);
+  frequency = 600;
+}
+
+void Sidetone::setFrequency(word hz)
+{
+  if (hz > 0) frequency = hz;
+}
+
+word Sidetone::getFrequency() { return frequency; }
+
+#if defined(SIDETONE_HW_TIMER)
+void Sidetone::on() { simBoard.compareOutput(CONFIG_KEYING_SIDETONE, frequency); }
+
+void Sidetone::off() { simBoard.compareOutput(CONFIG_KEYING_SIDETONE, 0); }
+#else
+void Sidetone::on() { halTone(CONFIG_KEYING_SIDETONE, frequency); }
+
+void Sidetone::off() { halNoTone(CONFIG_KEYING_SIDETONE); }
+#endif
@@ -0,0 +1,154 @@
+/**
+ * Buffered keying soak test: sends a long text through the unmodified firmware while the main loop
+ * is artificially slow, and checks that the key line keeps exact timing without gaps.
+ *
+ * Usage: keying_soak [-w wpm] [-s seconds] [-t stall_us] [-n every]
+ *   -w wpm       buffer speed (default 40)
+ *   -s seconds   simulated time of every scenario (default 60 s)
+ *   -t stall_us  run one scenario with this main loop stall only (default: sweep 0 to 150 ms)
+ *   -n every     stall every n-th loop iteration (default 1 = every iteration)
+ *
+ * A stall stands for a slow protocol.service() or any other long tick: the simulated clock moves on
+ * while loop() is not running, timer interrupts still fire exactly on time. The host feeds text
+ * the way logging programs do, never more than a few characters ahead of the serial echo.
+ * Every key line mark must be 1 or 3 units and every space 1, 3 or 7 units (PARIS timing,
+ * weighting 50, ratio 3:1), within 2 us of rounding. Any other duration is a gap or a cut element,
+ * it is reported and the program exits with status 1.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "sim.h"
+#include "config_keying.h"
+
+void setup();
+void loop();
+
+static const char *TEXT = "CQ CQ DE OK1RR OK1RR TEST 5NN 73 PARIS ";
+static const byte HOST_AHEAD = 24; // characters in flight between host and serial echo
+
+struct Edge
+{
+  unsigned long long us;
+  byte level;
+};
+
+static std::vector<Edge> edges;
+
+static void onPin(byte pin, byte level, unsigned long long us)
+{
+  if (pin == CONFIG_KEYING_KEYLINE1)
+    edges.push_back({us, level});
+}
+
+/**
+ * Run the firmware with given loop stall and check the key line
+ * @return number of timing violations
+ */
+static unsigned long soak(int wpm, double seconds, unsigned long stallUs, unsigned long every)
+{
+  edges.clear();
+  simBoard.reset();
+  setup();
+  simBoard.setPinListener(onPin);
+  simBoard.hostWrite(0x00); // Host Open
+  simBoard.hostWrite(0x02);
+  simBoard.hostWrite(0x02); // buffer speed
+  simBoard.hostWrite((byte)wpm);
+  unsigned long long endUs = simBoard.now() + (unsigned long long)(seconds * 1e6);
+  unsigned long sent = 0, echoed = 0, loops = 0;
+  bool opened = false;
+  size_t textLength = strlen(TEXT);
+  while (simBoard.now() < endUs)
+  {
+    while (simBoard.hostAvailable())
+    {
+      byte b = simBoard.hostRead().value;
+      if (!opened)
+        opened = true; // revision byte
+      else if (b < 0x80)
+        echoed++;      // serial echo of a character going on the air
+    }
+    while (opened && sent - echoed < HOST_AHEAD)
+      simBoard.hostWrite(TEXT[sent++ % textLength]);
+    loop();
+    simBoard.advance((++loops % every == 0) ? stallUs : 50);
+  }
+  simBoard.setPinListener(0);
+  simBoard.hostWrite(0x0A); // Clear Buffer and Host Close, firmware singletons survive to the next scenario
+  simBoard.hostWrite(0x00);
+  simBoard.hostWrite(0x03);
+  for (endUs = simBoard.now() + 1000000UL; simBoard.now() < endUs; simBoard.advance(50))
+    loop();
+  // the text never ends, so every edge between the first and the last one is checked
+  unsigned long unit = 1200000UL / wpm;
+  unsigned long violations = 0;
+  unsigned long long worst = 0;
+  for (size_t i = 1; i < edges.size(); i++)
+  {
+    unsigned long long d = edges[i].us - edges[i - 1].us;
+    bool mark = (edges[i - 1].level == HIGH);
+    bool ok = false;
+    for (byte units = 1; units <= 7; units++)
+    {
+      if ((mark && units != 1 && units != 3) || (!mark && units != 1 && units != 3 && units != 7))
+        continue;
+      unsigned long long expected = (unsigned long long)units * unit;
+      unsigned long long diff = (d > expected) ? d - expected : expected - d;
+      if (diff <= 2)
+        ok = true;
+    }
+    if (!ok)
+    {
+      if (violations < 5)
+        printf("  %s of %.3f ms at %.3f ms\n", mark ? "mark" : "space", d / 1000.0, edges[i - 1].us / 1000.0);
+      if (d > worst)
+        worst = d;
+      violations++;
+    }
+  }
+  printf("stall %6lu us every %lu loops: %6zu edges, %lu violations%s\n",
+         stallUs, every, edges.size(), violations, edges.size() < 100 ? " (too few edges)" : "");
+  return violations + (edges.size() < 100);
+}
+
+int main(int argc, char **argv)
+{
+  int wpm = 40;
+  double seconds = 60.0;
+  long stall = -1;
+  unsigned long every = 1;
+  for (int i = 1; i + 1 < argc; i += 2)
+  {
+    if (strcmp(argv[i], "-w") == 0)
+      wpm = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-s") == 0)
+      seconds = atof(argv[i + 1]);
+    else if (strcmp(argv[i], "-t") == 0)
+      stall = atol(argv[i + 1]);
+    else if (strcmp(argv[i], "-n") == 0)
+      every = strtoul(argv[i + 1], 0, 10);
+    else
+    {
+      fprintf(stderr, "usage: %s [-w wpm] [-s seconds] [-t stall_us] [-n every]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (wpm < 6 || wpm > 99 || every == 0)
+  {
+    fprintf(stderr, "speed must be 6 to 99 WPM, every at least 1\n");
+    return 2;
+  }
+  unsigned long failed = 0;
+  if (stall >= 0)
+    failed = soak(wpm, seconds, stall, every);
+  else
+  {
+    static const unsigned long sweep[] = {50, 5000, 20000, 60000, 150000};
+    for (byte i = 0; i < sizeof(sweep) / sizeof(sweep[0]); i++)
+      failed += soak(wpm, seconds, sweep[i], every);
+  }
+  printf(failed ? "FAILED\n" : "all scenarios gapless\n");
+  return failed ? 1 : 0;
+}
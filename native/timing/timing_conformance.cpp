@@ -0,0 +1,487 @@
+/**
+ * Keying timing conformance: runs the unmodified firmware on the simulated board, records every key line
+ * and sidetone transition and compares them with ideal timing for every speed from 5 to 99 WPM.
+ *
+ * Usage: timing_conformance [-w wpm] [-l loop_us] [-v]
+ *   -w wpm      check this speed only (default: every speed 5 to 99)
+ *   -l loop_us  simulated cost of one loop() iteration in microseconds (default 50)
+ *   -v          print the result of every speed, not only the summary
+ *
+ * Scenarios:
+ *   paris, codex, random   buffered text sent by host (Winkeyer protocol), weighting 50, ratio 3:1
+ *   weight30, weight70     PARIS with weighting 30 and 70 (command 0x03)
+ *   ratio33, ratio66       PARIS with dah:dit ratio 2:1 and 4:1 (command 0x17)
+ *   qsk3                   PARIS with 3 ms QSK compensation (command 0x11)
+ *   iambic_a, iambic_b     squeeze: dit pressed, dah added during the first dit, both released in the
+ *                          space after the 4th element; Iambic A sends 4 elements, Iambic B 5
+ *   ultimatic              dit held, dah added after 2 dits, dah released after 2 dahs, dit released
+ *                          after 2 more dits: the paddle pressed last wins, 6 elements
+ * Paddle speed is set directly by KeyingInterface::setSpeed(), the speed control stands in for it on target.
+ *
+ * Ideal timing (ITU, PARIS = 50 units, unit = 1.2 s / WPM) with the keyer parameters:
+ *   dit mark = unit * weighting / 50, dah mark = dit mark * 3 * ratio / 50, both + QSK compensation;
+ *   element space = 2 units - dit mark - QSK compensation, at least 1/4 unit, so that the dit period
+ *   and the speed stay the same; character space adds 2 units, word space 4 more units.
+ * Every recorded mark and space is compared with its ideal duration (error), and every edge with its ideal
+ * time counted from the first one (drift). The report gives mean error, max jitter (largest error of
+ * a single mark or space) and max cumulative drift, all in microseconds.
+ *
+ * Pass criteria, they assume hardware timer element timing (CONFIG_KEYING_HW_TIMER):
+ *   - the element sequence is exactly the expected one
+ *   - every mark, and every space of buffered text, within 2 us (whole microseconds with carried fraction)
+ *   - drift of buffered text within 2 us + 20 ppm (1/16 us fixed point of unit, weighting and ratio)
+ *   - paddle spaces not shorter than ideal and at most one loop iteration longer: the next paddle element
+ *     is chosen by service(), which follows the timer interrupt in the next loop iteration
+ *   - sidetone follows every key edge within one loop iteration (switched by service())
+ * Any failure is reported and the program exits with status 1.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "sim.h"
+#include "config_keying.h"
+#include "keying.h"
+
+void setup();
+void loop();
+
+static unsigned long loopUs = 50;
+static bool verbose = false;
+
+/* ----- recording ----- */
+
+struct Edge
+{
+  unsigned long long us;
+  bool on;
+};
+
+static std::vector<Edge> keyEdges, toneEdges;
+
+static void onPin(byte pin, byte level, unsigned long long us)
+{
+  if (pin == CONFIG_KEYING_KEYLINE1)
+    keyEdges.push_back({us, level == HIGH});
+}
+
+static void onTone(byte, word hz, unsigned long long us)
+{
+  if (toneEdges.empty() || toneEdges.back().on != (hz > 0))
+    toneEdges.push_back({us, hz > 0});
+}
+
+/* ----- ideal timing ----- */
+
+struct Parameters
+{
+  int weighting; // Winkeyer 0x03, 50 = 1:1
+  int ratio;     // Winkeyer 0x17, 50 = 3:1
+  int qskMs;     // Winkeyer 0x11
+};
+
+struct IdealTiming
+{
+  double unit, mark[2], space;
+};
+
+static IdealTiming idealTiming(int wpm, const Parameters &p)
+{
+  IdealTiming t;
+  t.unit = 1200000.0 / wpm;
+  double dit = t.unit * p.weighting / 50.0;
+  t.mark[0] = dit + p.qskMs * 1000.0;
+  t.mark[1] = dit * 3.0 * p.ratio / 50.0 + p.qskMs * 1000.0;
+  t.space = 2.0 * t.unit - dit - p.qskMs * 1000.0;
+  if (t.space < t.unit / 4)
+    t.space = t.unit / 4;
+  return t;
+}
+
+/** Expected mark or space */
+struct Expected
+{
+  double us;
+  bool mark;
+};
+
+static const char *const ITU[] = {
+  ".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..", ".---", "-.-", ".-..", "--",
+  "-.", "---", ".--.", "--.-", ".-.", "...", "-", "..-", "...-", ".--", "-..-", "-.--", "--..",
+  "-----", ".----", "..---", "...--", "....-", ".....", "-....", "--...", "---..", "----."};
+
+static const char *itu(char c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return ITU[c - 'A'];
+  if (c >= '0' && c <= '9')
+    return ITU[26 + c - '0'];
+  return 0;
+}
+
+/** Marks and spaces of text; spaces after the last mark are not recorded, so they are left out */
+static std::vector<Expected> expectText(const std::string &text, const IdealTiming &t)
+{
+  std::vector<Expected> e;
+  for (char c : text)
+  {
+    if (c == ' ')
+    {
+      if (!e.empty())
+        e.back().us += 4 * t.unit; // word space after character space
+      continue;
+    }
+    for (const char *p = itu(c); *p; p++)
+    {
+      e.push_back({t.mark[*p == '-'], true});
+      e.push_back({t.space, false});
+    }
+    e.back().us += 2 * t.unit; // character space after element space
+  }
+  while (!e.empty() && !e.back().mark)
+    e.pop_back();
+  return e;
+}
+
+/** Paddle elements: ".-" etc., every mark followed by element space */
+static std::vector<Expected> expectElements(const char *elements, const IdealTiming &t)
+{
+  std::vector<Expected> e;
+  for (const char *p = elements; *p; p++)
+  {
+    if (!e.empty())
+      e.push_back({t.space, false});
+    e.push_back({t.mark[*p == '-'], true});
+  }
+  return e;
+}
+
+/* ----- comparison ----- */
+
+struct Result
+{
+  double errorSum = 0; // signed errors of all marks and spaces
+  unsigned long count = 0;
+  double jitter = 0;   // largest absolute error
+  double drift = 0;    // largest absolute cumulative drift
+  double toneLag = 0;  // largest sidetone delay behind key line
+  bool ok = true;
+  std::string problem;
+};
+
+static void fail(Result &r, const char *format, double a, double b)
+{
+  if (r.ok)
+  {
+    char text[120];
+    snprintf(text, sizeof(text), format, a, b);
+    r.problem = text;
+  }
+  r.ok = false;
+}
+
+/**
+ * Compare recording with expected marks and spaces
+ * @param paddles spaces may be late by one loop iteration, drift is reported only
+ */
+static Result compare(const std::vector<Expected> &expected, bool paddles)
+{
+  Result r;
+  size_t durations = keyEdges.empty() ? 0 : keyEdges.size() - 1;
+  if (keyEdges.empty() || !keyEdges[0].on || durations != expected.size())
+  {
+    fail(r, "%.0f key line edges recorded, %.0f expected", keyEdges.size(), expected.size() + 1);
+    return r;
+  }
+  double ideal = 0;
+  for (size_t i = 0; i < durations; i++)
+  {
+    double measured = keyEdges[i + 1].us - keyEdges[i].us;
+    double error = measured - expected[i].us;
+    ideal += expected[i].us;
+    double drift = (keyEdges[i + 1].us - keyEdges[0].us) - ideal;
+    r.errorSum += error;
+    r.count++;
+    if (fabs(error) > r.jitter)
+      r.jitter = fabs(error);
+    if (fabs(drift) > r.drift)
+      r.drift = fabs(drift);
+    if (keyEdges[i].on != expected[i].mark)
+      fail(r, "edge %.0f at %.0f us has wrong level", i, keyEdges[i].us);
+    else if (paddles && !expected[i].mark)
+    {
+      if (error < -2 || error > loopUs + 2)
+        fail(r, "paddle space %.1f us off ideal %.1f us", error, expected[i].us);
+    }
+    else if (fabs(error) > 2)
+      fail(r, expected[i].mark ? "mark %.1f us off ideal %.1f us" : "space %.1f us off ideal %.1f us", error,
+           expected[i].us);
+    if (!paddles && fabs(drift) > 2 + 20e-6 * ideal)
+      fail(r, "drift %.1f us after %.0f us", drift, ideal);
+  }
+  if (toneEdges.size() != keyEdges.size())
+    fail(r, "%.0f sidetone edges, %.0f key line edges", toneEdges.size(), keyEdges.size());
+  else
+    for (size_t i = 0; i < keyEdges.size(); i++)
+    {
+      double lag = (double)toneEdges[i].us - (double)keyEdges[i].us;
+      if (lag > r.toneLag)
+        r.toneLag = lag;
+      if (toneEdges[i].on != keyEdges[i].on || lag < 0 || lag > loopUs + 2)
+        fail(r, "sidetone %.1f us behind key line edge %.0f", lag, i);
+    }
+  return r;
+}
+
+/* ----- firmware driver ----- */
+
+/** Paddle contact change, applied between loop iterations */
+struct PaddleAction
+{
+  unsigned long long us;
+  byte pin;
+  byte level;
+};
+
+/** Paddle contact change in the middle of the space after the n-th mark */
+struct PaddleTrigger
+{
+  size_t afterMarks;
+  byte pin;
+  byte level;
+};
+
+static const byte DIT_PIN = 3; // left paddle, contacts close to ground
+static const byte DAH_PIN = 2;
+
+static void runFor(unsigned long long us, std::vector<PaddleAction> actions = {},
+                   std::vector<PaddleTrigger> triggers = {}, double halfSpace = 0)
+{
+  unsigned long long end = simBoard.now() + us;
+  while (simBoard.now() < end)
+  {
+    size_t marks = 0;
+    for (size_t i = 1; i < keyEdges.size(); i++)
+      if (!keyEdges[i].on)
+        if (++marks == (triggers.empty() ? 0 : triggers[0].afterMarks))
+        {
+          actions.push_back({keyEdges[i].us + (unsigned long long)halfSpace, triggers[0].pin, triggers[0].level});
+          triggers.erase(triggers.begin());
+        }
+    for (size_t i = 0; i < actions.size();)
+      if (actions[i].us <= simBoard.now())
+      {
+        simBoard.setInput(actions[i].pin, actions[i].level);
+        actions.erase(actions.begin() + i);
+      }
+      else
+        i++;
+    while (simBoard.hostAvailable())
+      simBoard.hostRead(); // echo and status are not checked here
+    loop();
+    simBoard.advance(loopUs);
+  }
+}
+
+static void hostSend(const std::vector<byte> &bytes)
+{
+  for (byte b : bytes)
+    simBoard.hostWrite(b);
+}
+
+/**
+ * Power-on state. Firmware singletons survive setup(), so whatever is left of the last scenario is cleared first.
+ * EEPROM is erased so that settings saved by the last scenario do not leak into this one,
+ * the power-up beep is over before recording starts.
+ */
+static void freshBoard()
+{
+  simBoard.setPinListener(0);
+  simBoard.setToneListener(0);
+  simBoard.setInput(DIT_PIN, HIGH);
+  simBoard.setInput(DAH_PIN, HIGH);
+  hostSend({0x0A, 0x00, 0x03}); // Clear Buffer and Host Close
+  runFor(1000000UL);
+  simBoard.eraseEeprom();
+  simBoard.reset();
+  setup();
+  runFor(300000UL);
+  keyEdges.clear();
+  toneEdges.clear();
+  simBoard.setPinListener(onPin);
+  simBoard.setToneListener(onTone);
+}
+
+static double total(const std::vector<Expected> &e)
+{
+  double us = 0;
+  for (const Expected &x : e)
+    us += x.us;
+  return us;
+}
+
+static Result bufferedScenario(int wpm, const std::string &text, const Parameters &p)
+{
+  freshBoard();
+  hostSend({0x00, 0x02, 0x02, (byte)wpm, 0x03, (byte)p.weighting, 0x17, (byte)p.ratio, 0x11, (byte)p.qskMs});
+  for (char c : text)
+    simBoard.hostWrite(c);
+  std::vector<Expected> expected = expectText(text, idealTiming(wpm, p));
+  runFor((unsigned long long)total(expected) + 1000000UL);
+  return compare(expected, false);
+}
+
+static Result paddleScenario(int wpm, KeyerMode mode, const char *elements)
+{
+  freshBoard();
+  Parameters p = {50, 50, 0};
+  IdealTiming t = idealTiming(wpm, p);
+  keyer.setSpeed(PADDLE_SPEED, wpm);
+  keyer.setTimingParameters(300, 50); // QSK compensation of the last buffered scenario survives setup()
+  keyer.setQskCompensation(0);
+  keyer.setMode(mode);
+  unsigned long long start = simBoard.now() + 10000;
+  std::vector<PaddleAction> actions = {{start, DIT_PIN, LOW}};
+  std::vector<PaddleTrigger> triggers;
+  if (mode == ULTIMATIC)
+  {
+    triggers = {{2, DAH_PIN, LOW}, {4, DAH_PIN, HIGH}, {6, DIT_PIN, HIGH}};
+  }
+  else
+  {
+    actions.push_back({start + (unsigned long long)(t.mark[0] / 2), DAH_PIN, LOW});
+    triggers = {{4, DIT_PIN, HIGH}, {4, DAH_PIN, HIGH}};
+  }
+  std::vector<Expected> expected = expectElements(elements, t);
+  runFor((unsigned long long)(total(expected) + 20 * t.unit), actions, triggers, t.space / 2);
+  return compare(expected, true);
+}
+
+/* ----- scenarios and report ----- */
+
+static unsigned long seed = 1;
+
+/** Random text of letters and digits in words of 1 to 6 characters */
+static std::string randomText(int wpm)
+{
+  static const char CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  seed = 12345 + wpm;
+  std::string text;
+  for (int words = 0; words < 3; words++)
+  {
+    seed = seed * 1103515245UL + 12345UL;
+    int length = 1 + (seed >> 16) % 6;
+    for (int i = 0; i < length; i++)
+    {
+      seed = seed * 1103515245UL + 12345UL;
+      text += CHARS[(seed >> 16) % 36];
+    }
+    text += ' ';
+  }
+  return text;
+}
+
+enum ScenarioKind { BUFFERED, PADDLES };
+
+struct Scenario
+{
+  const char *name;
+  ScenarioKind kind;
+  const char *text; // buffered text, 0 = random; expected paddle elements
+  Parameters parameters;
+  KeyerMode mode;
+};
+
+static const Scenario SCENARIOS[] = {
+  {"paris", BUFFERED, "PARIS PARIS ", {50, 50, 0}, IAMBIC_B},
+  {"codex", BUFFERED, "CODEX CODEX ", {50, 50, 0}, IAMBIC_B},
+  {"random", BUFFERED, 0, {50, 50, 0}, IAMBIC_B},
+  {"weight30", BUFFERED, "PARIS ", {30, 50, 0}, IAMBIC_B},
+  {"weight70", BUFFERED, "PARIS ", {70, 50, 0}, IAMBIC_B},
+  {"ratio33", BUFFERED, "PARIS ", {50, 33, 0}, IAMBIC_B},
+  {"ratio66", BUFFERED, "PARIS ", {50, 66, 0}, IAMBIC_B},
+  {"qsk3", BUFFERED, "PARIS ", {50, 50, 3}, IAMBIC_B},
+  {"iambic_a", PADDLES, ".-.-", {50, 50, 0}, IAMBIC_A},
+  {"iambic_b", PADDLES, ".-.-.", {50, 50, 0}, IAMBIC_B},
+  {"ultimatic", PADDLES, "..--..", {50, 50, 0}, ULTIMATIC},
+};
+static const int SCENARIO_COUNT = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+
+struct Summary
+{
+  double errorSum = 0;
+  unsigned long count = 0;
+  double jitter = 0, drift = 0, toneLag = 0;
+  int jitterWpm = 0, driftWpm = 0;
+  unsigned failures = 0;
+};
+
+int main(int argc, char **argv)
+{
+  int first = 5, last = 99;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+      first = last = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+      loopUs = strtoul(argv[++i], 0, 10);
+    else if (strcmp(argv[i], "-v") == 0)
+      verbose = true;
+    else
+    {
+      fprintf(stderr, "usage: %s [-w wpm] [-l loop_us] [-v]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (first < 5 || last > 99 || loopUs == 0)
+  {
+    fprintf(stderr, "speed must be 5 to 99 WPM, loop cost at least 1 us\n");
+    return 2;
+  }
+  simBoard.reset();
+  setup();
+  Summary summary[SCENARIO_COUNT];
+  for (int wpm = first; wpm <= last; wpm++)
+    for (int s = 0; s < SCENARIO_COUNT; s++)
+    {
+      const Scenario &scenario = SCENARIOS[s];
+      Result r = (scenario.kind == PADDLES)
+                     ? paddleScenario(wpm, scenario.mode, scenario.text)
+                     : bufferedScenario(wpm, scenario.text ? scenario.text : randomText(wpm), scenario.parameters);
+      Summary &sum = summary[s];
+      sum.errorSum += r.errorSum;
+      sum.count += r.count;
+      if (r.jitter >= sum.jitter)
+      {
+        sum.jitter = r.jitter;
+        sum.jitterWpm = wpm;
+      }
+      if (r.drift >= sum.drift)
+      {
+        sum.drift = r.drift;
+        sum.driftWpm = wpm;
+      }
+      if (r.toneLag > sum.toneLag)
+        sum.toneLag = r.toneLag;
+      if (!r.ok)
+        sum.failures++;
+      if (verbose || (!r.ok && sum.failures <= 3))
+        printf("%3d WPM %-10s mean %7.3f jitter %7.1f drift %7.1f tone %5.1f us%s%s\n", wpm, scenario.name,
+               r.count ? r.errorSum / r.count : 0.0, r.jitter, r.drift, r.toneLag, r.ok ? "" : "  FAILED: ",
+               r.problem.c_str());
+    }
+  unsigned failures = 0;
+  printf("%-10s %10s %17s %17s %9s  %s\n", "scenario", "mean us", "max jitter us", "max drift us", "tone us", "result");
+  for (int s = 0; s < SCENARIO_COUNT; s++)
+  {
+    const Summary &sum = summary[s];
+    printf("%-10s %10.3f %9.1f @%2d WPM %9.1f @%2d WPM %9.1f  %s\n", SCENARIOS[s].name,
+           sum.count ? sum.errorSum / sum.count : 0.0, sum.jitter, sum.jitterWpm, sum.drift, sum.driftWpm,
+           sum.toneLag, sum.failures ? "FAILED" : "OK");
+    failures += sum.failures;
+  }
+  printf(failures ? "%u runs FAILED\n" : "all %d speeds conform\n", failures ? failures : last - first + 1);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,47 @@
+# Compare two runs of the native benchmark suite (native/perf/perf_suite.cpp).
+#
+#   .pio/build/native_perf/program -l old > old.json
+#   .pio/build/native_perf/program -l new > new.json
+#   python scripts/bench_compare.py old.json new.json [threshold_percent]
+#
+# Prints time per operation of both runs and their ratio for every benchmark, and exits with status 1
+# when any benchmark got slower by more than threshold (default 10 %). Benchmarks present in one run
+# only are listed but do not fail the comparison. Both runs must come from the same machine.
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def main(argv):
+    if len(argv) < 3:
+        print("usage: bench_compare.py old.json new.json [threshold_percent]")
+        return 2
+    old, new = load(argv[1]), load(argv[2])
+    threshold = float(argv[3]) if len(argv) > 3 else 10.0
+    print("%-24s %12s %12s %8s" % ("benchmark", old.get("label") or "old", new.get("label") or "new", "ratio"))
+    regressions = 0
+    names = list(old["results"]) + [n for n in new["results"] if n not in old["results"]]
+    for name in names:
+        a = old["results"].get(name)
+        b = new["results"].get(name)
+        if a is None or b is None:
+            print("%-24s %12s %12s %8s" % (name, "%.3f" % a["ns_per_op"] if a else "-",
+                                           "%.3f" % b["ns_per_op"] if b else "-", "-"))
+            continue
+        ratio = b["ns_per_op"] / a["ns_per_op"] if a["ns_per_op"] > 0 else float("inf")
+        slower = ratio > 1.0 + threshold / 100.0
+        regressions += slower
+        print("%-24s %12.3f %12.3f %7.2fx%s" % (name, a["ns_per_op"], b["ns_per_op"], ratio,
+                                               "  SLOWER" if slower else ""))
+    if regressions:
+        print("%d benchmark(s) slower by more than %.0f %%" % (regressions, threshold))
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,82 @@
+# PlatformIO extra script: RAM/flash budget report for AVR and LGT8F328P targets.
+#
+#   pio run -e AVR -t size_report
+#
+# Prints static RAM (.data + .bss + .noinit) and flash (.text + .data) usage, the largest symbols
+# of both, and fails when usage exceeds custom_ram_budget or custom_flash_budget of the environment.
+# RAM budget should leave enough headroom below physical RAM for stack, including interrupt nesting.
+
+import subprocess
+
+Import("env")
+
+TOP_SYMBOLS = 20
+
+
+def tool(name):
+    # avr-gcc -> avr-size / avr-nm from the same toolchain
+    cc = env.subst("$CC")
+    return cc[: -len("gcc")] + name if cc.endswith("gcc") else name
+
+
+def section_sizes(elf):
+    sizes = {}
+    out = subprocess.check_output([tool("size"), "-A", elf], universal_newlines=True)
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith(".") and parts[1].isdigit():
+            sizes[parts[0]] = int(parts[1])
+    return sizes
+
+
+def symbols(elf):
+    ram, flash = [], []
+    out = subprocess.check_output([tool("nm"), "--size-sort", "-S", "-C", elf], universal_newlines=True)
+    for line in out.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) < 4:
+            continue
+        size, kind, name = int(parts[1], 16), parts[2].lower(), parts[3]
+        if kind in ("b", "d"):
+            ram.append((size, name))
+        if kind in ("t", "w", "d", "r"):
+            flash.append((size, name))
+    return sorted(ram, reverse=True), sorted(flash, reverse=True)
+
+
+def print_top(title, items):
+    print("%s (top %d):" % (title, TOP_SYMBOLS))
+    for size, name in items[:TOP_SYMBOLS]:
+        print("  %6d  %s" % (size, name))
+
+
+def check(label, used, budget):
+    if budget <= 0:
+        print("%-5s %6d bytes (no budget set)" % (label, used))
+        return True
+    ok = used <= budget
+    print("%-5s %6d of %6d bytes budget, %s" % (label, used, budget, "OK" if ok else "EXCEEDED"))
+    return ok
+
+
+def size_report(target, source, env):
+    elf = env.subst("$BUILD_DIR/${PROGNAME}.elf")
+    sections = section_sizes(elf)
+    ram_used = sections.get(".data", 0) + sections.get(".bss", 0) + sections.get(".noinit", 0)
+    flash_used = sections.get(".text", 0) + sections.get(".data", 0)
+    ram, flash = symbols(elf)
+    print("Budget report for environment %s" % env.subst("$PIOENV"))
+    print_top("RAM", ram)
+    print_top("Flash", flash)
+    ram_ok = check("RAM", ram_used, int(env.GetProjectOption("custom_ram_budget", "0")))
+    flash_ok = check("Flash", flash_used, int(env.GetProjectOption("custom_flash_budget", "0")))
+    return 0 if (ram_ok and flash_ok) else 1
+
+
+env.AddCustomTarget(
+    name="size_report",
+    dependencies="$BUILD_DIR/${PROGNAME}.elf",
+    actions=size_report,
+    title="Size report",
+    description="RAM/flash per-symbol breakdown, fails when budget is exceeded",
+)
@@ -1,92 +1,152 @@
+#include "hal.h"
 #include "keying.h"
 #include "paddle.h"
 #include "speed_control.h"
 #include "protocol.h"
 #include "morse.h"
+#include "profiler.h"
+#include "scheduler.h"
+#include "settings.h"
 
 // debugging
 unsigned long blikTime = 0 ;
-const byte LED = CONFIG_CMD_MODE_LED ;
+typedef FastPin<CONFIG_CMD_MODE_LED> CmdModeLed ;
 void blik(bool);
+// power-up beep and flash, played by loop so that the host is served from the start
+byte bootBeepStep = 0 ;
+unsigned long bootBeepTime = 0 ;
+void bootBeep();
+void serialEcho(byte ascii) { protocol.sendSerialEcho(ascii); } // keyer echoes buffered text as it is sent
 
 /* GLOBAL VARIABLES */
 KeyingSource keySource = SRC_PADDLE ;
-int speedPaddles = 25 ;
-int speedBuffer = 20 ;
-int speedCommand = 20 ;
+int speedPaddles = 25 ; // buffered text and buffered speed changes have their own timing profiles in keyer
 unsigned long currentTime ;
+unsigned long currentMicros ;
 
 void setup() {
-  protocol.init();
   // BUFFER indicator setup
-  pinMode( LED_BUILTIN, OUTPUT );
-  digitalWrite( LED_BUILTIN, HIGH );
+  FastPin<LED_BUILTIN>::output();
+  FastPin<LED_BUILTIN>::high();
   // basic component setup
   keyer.init();
   keyer.setDefaults();
+  keyer.setEchoListener(serialEcho);
   paddle.init();
   speedControl->init(); // includes also command mode LED
-  speedControl->setMinMax(15,46);
-  speedControl->setValue(speedPaddles);
-   // initial beep and flash
-  keyer.setTone(300);
-  digitalWrite( LED, HIGH );
-  delay(133);
-  keyer.setTone(1300);
-  delay(133);
-  digitalWrite( LED, LOW );
-  keyer.setTone(0);
-  delay(100);
+  // Winkeyer defaults block saved in EEPROM (factory defaults if none): mode, speed, pot range, timing
+  settings.load();
+  protocol.applySettings();
+  speedPaddles = speedControl->getValue();
+  keyer.setSpeed( PADDLE_SPEED, speedPaddles );
+  protocol.init();
   // initial
-  currentTime = millis();
+  currentTime = halMillis();
+  currentMicros = halMicros();
   keyer.service(0);
-  digitalWrite( LED_BUILTIN, LOW );
-  // testing parameters
-  protocol.enablePaddleEcho( ON );
+  scheduler.resetStats();
+  FastPin<LED_BUILTIN>::low();
+  // initial beep and flash, continues in loop
+  bootBeepTime = currentTime;
+  keyer.setTone(300);
+  CmdModeLed::high();
+  bootBeepStep = 1;
 }
 
 void loop() {
+  scheduler.startLoop();
+  profiler.startLoop();
   // fix current time at the beginning of the loop
-  currentTime = millis();
+  currentTime = halMillis();
+  currentMicros = halMicros();
   // let speed control update current value if anything changed by ISR
+  profiler.start();
   speedControl->update();
+  profiler.stop(PROF_SPEED_CONTROL);
   int speed = speedControl->getValue();
   // update keyer timing according to new value from speed control
   if( speed != speedPaddles ) {
     speedPaddles = speed ;
-    keyer.setTimingParameters( speedPaddles );
+    keyer.setSpeed( PADDLE_SPEED, speedPaddles );
+    settings.set( SETTING_SPEED, speedPaddles ); // saved with the rest of settings after a while
     blik(true);
-    protocol.sendResponse( speedControl->getSpeedWk2() ); // send WK status speed info if speed changed
+    protocol.sendPotValue( speedControl->getSpeedWk2() ); // send WK status speed info if speed changed
   }
   else blik(false); // this ensures LED flash when speed is changed
-  // check current paddle state (just read ports, nothing else)
+  // check current paddle state: levels and short taps captured by paddle interrupt since the last loop
+  profiler.start();
   byte paddleState = paddle.check();
+  byte pressed = paddle.takePressed();
+  if (pressed) keyer.recordPaddle(pressed, paddle.getPressTime()); // Iambic B memory with real press time
+  profiler.stop(PROF_PADDLE);
   // Service one tick in timing (key down, sidetone, pause between elements). 
   // Variable paddleState is used to determine the next element if necessary. 
+  profiler.start();
   KeyerState keyerState = keyer.service( paddleState ) ; // for details see keying.cpp
+  profiler.stop(PROF_KEYER);
+  profiler.start();
   protocol.service(keyerState); // Check incoming serial data and execute command if necessary
-  // The following block will fetch next morse code into keyer if keyer ready and morse code available from buffer
-  if( keyer.canAccept() ) 
+  profiler.stop(PROF_PROTOCOL);
+  // The following block fetches morse codes into keyer while keyer has room and morse codes are available from buffer.
+  // Keyer expands them to its element queue at once, so the element train does not depend on the next loop iteration.
+  while( keyer.canAccept() ) 
   { 
-     byte x = protocol.getNextMorseCode(); // also send new status re XON, XOFF; returns 0 if nothing available in the buffer
-     keyerState = keyer.sendCode( x );     // send obtained morse code; does nothing if code is zero
+     profiler.start();
+     byte ascii;
+     word x = protocol.getNextMorseCode( ascii ); // also send new status re XON, XOFF; returns 0 if nothing available in the buffer
+     profiler.stop(PROF_FETCH);
+     if( x == 0 ) break;
+     keyerState = keyer.sendCode( x, ascii );     // send obtained morse code or buffered command
   }
   // The following block retrieves morse code just played on paddles and converts to ASCII char
   if( keyerState.source == SRC_PADDLE && keyerState.busy == READY ) {
     word code = keyer.getCollectedCode(); // keyer timing also detects word space and returns special code if detected
+    profiler.start();
     byte ascii = morse.decodeMorse(code);
+    profiler.stop(PROF_DECODE);
     if( ascii >= ' ' ) protocol.sendPaddleEcho(ascii); // this actually sends echo only if enabled and character makes sense
   }
   protocol.sendStatus(keyerState); // after all functions have been serviced, send new Winkeyer status if Winkeyer status changed
+  if( bootBeepStep ) bootBeep();
+  settings.service(); // write changed settings to EEPROM, a byte at a time
+  // collect deadlines and sleep until the earliest one or until any interrupt
+  keyer.schedule();
+  paddle.schedule();
+  protocol.schedule();
+  profiler.endLoop();
+  scheduler.sleep();
+}
+
+// power-up beep and flash: 133 ms 300 Hz, 133 ms 1300 Hz; keying cuts it short
+void bootBeep() {
+  if( keyer.getState().busy == BUSY ) {
+    if( keyer.getState().key == OFF ) keyer.setTone(0);
+    CmdModeLed::low();
+    bootBeepStep = 0;
+    return;
+  }
+  unsigned long elapsed = currentTime - bootBeepTime;
+  if( bootBeepStep == 1 && elapsed >= 133 ) {
+    keyer.setTone(1300);
+    bootBeepStep = 2;
+  }
+  else if( bootBeepStep == 2 && elapsed >= 266 ) {
+    keyer.setTone(0);
+    CmdModeLed::low();
+    bootBeepStep = 0;
+    return;
+  }
+  scheduler.wakeAt( currentMicros + 1000UL );
 }
 
 // speed change indicator
 void blik(bool start) {
   if( start ) {
-    blikTime = currentTime + 5;
-    digitalWrite(LED, HIGH);
+    blikTime = currentTime;
+    CmdModeLed::high();
   }
-  else if( blikTime < currentTime ) {
-    digitalWrite( LED, LOW );
+  else if( currentTime - blikTime > 5 ) { // elapsed time is safe across millis() wraparound
+    CmdModeLed::low();
   }
+  else scheduler.wakeAt( currentMicros + 1000UL ); // LED still on, check again in a millisecond
 }
\ No newline at end of file
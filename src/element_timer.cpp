@@ -0,0 +1,90 @@
+#include "element_timer.h"
+
+#if defined(CONFIG_KEYING_HW_TIMER) && !defined(CHALLENGER_NATIVE)
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+ElementTimer elementTimer; // element timer singleton
+
+// Timer1 runs with prescaler 64: 4 us per tick at 16 MHz, 2 us per tick at 32 MHz (LGT8F328P)
+static const unsigned long TICK_US = 64UL / (F_CPU / 1000000UL);
+static const word MAX_CHUNK = 0x8000;
+
+static ElementTimer::Handler deadlineHandler = 0;
+static volatile unsigned long remainingTicks = 0;
+static byte residueUs = 0; // part of microsecond interval shorter than one tick, carried to the next deadline
+
+/**
+ * @return number of timer ticks for given time, at least 2 to make sure compare match is not missed
+ */
+static unsigned long usToTicks(unsigned long us)
+{
+  us += residueUs;
+  residueUs = us % TICK_US;
+  unsigned long ticks = us / TICK_US;
+  return (ticks < 2) ? 2 : ticks;
+}
+
+/**
+ * Move compare register forward by the next chunk of remaining time. Interrupts must be disabled.
+ */
+static void scheduleChunk()
+{
+  word chunk = (remainingTicks > MAX_CHUNK) ? MAX_CHUNK : (word)remainingTicks;
+  remainingTicks -= chunk;
+  OCR1A += chunk;
+  word now = TCNT1;
+  if ((word)(OCR1A - now) > chunk) // chained deadline already passed due to interrupt latency
+    OCR1A = now + 2;               // fire as soon as possible instead of after timer overflow
+}
+
+void ElementTimer::init(Handler handler)
+{
+  deadlineHandler = handler;
+  TIMSK1 &= ~(1 << OCIE1A);
+  TCCR1A = 0;                         // normal mode, OC1A and OC1B disconnected
+  TCCR1B = (1 << CS11) | (1 << CS10); // prescaler 64
+}
+
+void ElementTimer::start(unsigned long us)
+{
+  byte sreg = SREG;
+  cli();
+  residueUs = 0;
+  remainingTicks = usToTicks(us);
+  OCR1A = TCNT1;
+  scheduleChunk();
+  TIFR1 = (1 << OCF1A); // clear stale compare match
+  TIMSK1 |= (1 << OCIE1A);
+  SREG = sreg;
+}
+
+/**
+ * Chain next deadline to the previous one, so that timing does not depend on interrupt latency
+ */
+void ElementTimer::next(unsigned long us)
+{
+  remainingTicks = usToTicks(us);
+  scheduleChunk();
+  TIMSK1 |= (1 << OCIE1A);
+}
+
+void ElementTimer::stop()
+{
+  TIMSK1 &= ~(1 << OCIE1A);
+  remainingTicks = 0;
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+  if (remainingTicks > 0)
+  {
+    scheduleChunk(); // long interval, deadline not reached yet
+    return;
+  }
+  TIMSK1 &= ~(1 << OCIE1A); // one shot, handler re-enables by next()
+  deadlineHandler();
+}
+
+#endif
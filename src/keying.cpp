@@ -1,14 +1,22 @@
 #include <Arduino.h>
+#include "hal.h"
 #include "keying.h"
+#include "element_timer.h"
+#include "sidetone.h"
+#include "scheduler.h"
 
 // Keying interface singleton
 KeyingInterface keyer = KeyingInterface() ;
 
+#if defined(CONFIG_KEYING_HW_TIMER)
+static void onElementDeadline() { keyer.timerDeadline(); }
+#endif
+
 /**
  * @return true if keyer buffer has space for new morse code
  */
 bool KeyingInterface::canAccept() {
-  return (status.breakIn == OFF && nextMorse == 0);
+  return (status.breakIn == OFF && nextItem == 0 && !paused);
 }
 
 /**
@@ -23,7 +31,8 @@ void KeyingInterface::collectPaddleElement(ElementType element)
       morseCollector = 0;              // prepare collector for a new morse code
       // the following starts wait timeout for detection of word space
       // it is called only once, just when the current character has been completed and fixed
-      collectionTimeout = currentTime + unit * 4 ; // this is to ensure that we detect word space after at least 5T (not earlier)
+      collectionStart = currentMicros;
+      collectionTimeout = (profiles[PADDLE_SPEED].unitFx >> TIMING_FRACTION_BITS) * 4 ; // this is to ensure that we detect word space after at least 5T (not earlier)
     }
     return ;
   }
@@ -91,7 +100,8 @@ void KeyingInterface::setAutospace( EnableEnum newState ) {
 void KeyingInterface::setDefaults()
 {
   setMode(IAMBIC_B);
-  setTimingParameters(25, 300, 50);
+  setTimingParameters(300, 50);
+  setSpeed(PADDLE_SPEED, 25);
   enableTone(ENABLED);
 }
 
@@ -106,90 +116,348 @@ void KeyingInterface::setFarnsworthWpm(byte wpm)
  */
 void KeyingInterface::init()
 {
-  if (pin_keyline1 > 0)
-    pinMode(pin_keyline1, OUTPUT);
-  if (pin_pttline1 > 0)
-    pinMode(pin_pttline1, OUTPUT);
-  if (pin_sidetone > 0)
-    pinMode(pin_sidetone, OUTPUT);
+  KeyLine1::output();
+  PttLine1::output();
+  sidetone.init();
+  sidetone.setFrequency(toneFreq);
   if (pin_cpo_key > 0)
-    pinMode(pin_cpo_key, OUTPUT);
+    halPinMode(pin_cpo_key, OUTPUT);
+  for (byte i = 0; i < SPEED_PROFILES; i++)
+    setProfileUnit(i, 50000UL << TIMING_FRACTION_BITS); // 24 WPM until speed is set
   onTimer = 0UL;
   offTimer = 0UL;
   status.busy = READY;
+#if defined(CONFIG_KEYING_HW_TIMER)
+  elementTimer.init(onElementDeadline);
+#endif
 }
 
 /**
- * Prepare binary morse code for output.
+ * Prepare binary morse code or buffered command for output.
  * Effect:
- *  - ignore morse code 0 (no code, no output)
+ *  - ignore item 0 (no code, no output)
  *  - if not set, set keying source to SRC_BUFFER
- *  - add character to buffer if the buffer is not full
- * @param code binary code to send
- * @returns {bool} true on success, false otherwise (i.e. when buffer was already full)
+ *  - add item to buffer if the buffer is not full
+ * @param item binary code or command, see keyerItem()
+ * @param ascii character of the code for serial echo, zero = no echo
+ * @returns current status, accept is DISABLED when the buffer is full
  * 
 */
-KeyerState KeyingInterface::sendCode(byte code)
+KeyerState KeyingInterface::sendCode(word item, byte ascii)
 {
-  if( code == 0 ) return status ;
+  if( item == 0 ) return status ;
   status.source = SRC_BUFFER;
-  if (currentMorse == 0)
-    currentMorse = code;
+  if (currentMorse == 0 && nextItem == 0 && (item >> 8) <= ITEM_MERGE)
+  {
+    currentMorse = item & 0xFF;
+    currentAscii = ascii;
+    mergeCurrent = ((item >> 8) == ITEM_MERGE);
+  }
   else
   {
-    nextMorse = code;
+    nextItem = item;
+    nextAscii = ascii;
     status.accept = DISABLED;
   }
+  executeTimingItem();
+  fillQueue(); // expand to elements now, not when the keyer runs out of them
   return status ;
 }
 
+/**
+ * Compute mark and space durations of an element from the timing profile of its source:
+ * paddles, buffered text, or buffered text after buffered speed change. The profile is chosen here,
+ * i.e. exactly at the element boundary, and it only supplies precomputed durations.
+ * Durations are in 1/16 us and the fraction left after rounding down to whole microseconds
+ * is carried to the next duration, so that the element train keeps exact average speed.
+ * @param element element to compute
+ * @param markUs returns key down time, zero for spaces
+ * @param spaceUs returns key up time following the mark
+ */
+void KeyingInterface::elementTiming(ElementType element, unsigned long &markUs, unsigned long &spaceUs)
+{
+  unsigned long mark = 0UL;  // fixed point durations
+  unsigned long space = 0UL;
+  activeProfile = (status.source == SRC_PADDLE) ? PADDLE_SPEED : commandSpeed ? COMMAND_SPEED : BUFFER_SPEED;
+  const TimingProfile &profile = profiles[activeProfile];
+  switch (element)
+  {
+  case DIT:
+  case DAH:
+    mark = profile.markFx[element == DAH];
+    space = profile.spaceFx;
+    break;
+  // word space: add 4T pause after 3T character space
+  case WORDSPACE:
+    space = profile.unitFx << 2;
+    break;
+  // half space: add 3T
+  case HALFSPACE:
+    space = profile.unitFx * 3;
+    break;
+  // charspace: add 2T pause after the last element
+  case CHARSPACE:
+    space = profile.unitFx << 1;
+    break;
+  // buffered key down and wait
+  case KEYDOWN:
+    mark = (commandSeconds * 1000000UL) << TIMING_FRACTION_BITS;
+    break;
+  case WAIT:
+    space = (commandSeconds * 1000000UL) << TIMING_FRACTION_BITS;
+    break;
+  default:
+    break;
+  }
+  mark += timingResidue;
+  markUs = mark >> TIMING_FRACTION_BITS;
+  space += mark & TIMING_FRACTION_MASK;
+  spaceUs = space >> TIMING_FRACTION_BITS;
+  timingResidue = space & TIMING_FRACTION_MASK;
+}
+
 /***
  * Set element timers and status according to element.
  * @param element new current element to set up
  */
 void KeyingInterface::sendElement(ElementType element)
 {
-  word elementFactor = 100;   // 100 for DIT, ditDahFactor for DAH
-  word extraSpaceFactor = 2;  // 2 for CHARSPACE, 4 for WORDSPACE
+  unsigned long markUs, spaceUs;
+  elementTiming(element, markUs, spaceUs);
+  memoryArmUs = currentMicros + markUs + (paddleSwitchpoint * (profiles[PADDLE_SPEED].unitFx >> TIMING_FRACTION_BITS)) / 100;
+  startElement(element, markUs, spaceUs);
+}
+
+/**
+ * Start element with given durations: set status, element timers, key line and sidetone.
+ */
+void KeyingInterface::startElement(ElementType element, unsigned long markUs, unsigned long spaceUs)
+{
   internal.current = element; // set new current element
   status.busy = BUSY;         // set new status
   paddleMemory = PADDLE_FREE;
-  // reset character collection timeout
+  onTimer = markUs;
+  offTimer = spaceUs;
   switch (element)
   {
   case NO_ELEMENT:
     status.busy = READY;
-    onTimer = 0UL;
-    offTimer = 0UL;
     setKey(OFF);
     setTone( 0 );
     break;
   case DAH:
-    elementFactor = ditDahFactor;
   case DIT:
-    onTimer = (unit * weighting) / 50UL; // DIT duration with weighting
-    offTimer = 2 * unit - onTimer;       // element space duration with weighting
-    // now comes the magic for DAH: multiply by ditDahFactor, but keep current for DIT
-    onTimer = (onTimer * elementFactor) / 100UL + qskCompensation ;
+  case KEYDOWN:
     setKey(ON);
     setTone(toneFreq);
     break;
-
-  // word space: add 4T pause after 3T character space
-  case WORDSPACE:
-    extraSpaceFactor = 4;
-  // half space: add 3T
-  case HALFSPACE:
-    extraSpaceFactor = 3;
-  // charspace: add 2T pause after the last element
-  case CHARSPACE:
-    onTimer = 0;
-    offTimer = unit * extraSpaceFactor ;
+  default: // spaces
     setKey(OFF);
     setTone(0);
     break;
   }
-  lastMillis = currentTime; // initialize reference currentTime for element timers
+  lastMicros = currentMicros; // initialize reference time for element timers
+#if defined(CONFIG_KEYING_HW_TIMER)
+  startTimer(onTimer, offTimer);
+#endif
+}
+
+/**
+ * Take next element of buffered morse code. Current code is shifted element by element,
+ * when it is finished, the next item is taken. Commands are executed when their turn comes:
+ * speed changes as soon as the previous code has no more elements, PTT is queued to switch
+ * when the previous element ends. Key down and wait are elements of their own.
+ * @param ascii returns character to echo when the element starts, zero if none
+ * @return next element or NO_ELEMENT if there are no more codes or a command was executed
+ */
+ElementType KeyingInterface::nextBufferElement(byte &ascii)
+{
+  ascii = 0;
+  executeTimingItem();
+  byte code = currentMorse;
+  bool merge = mergeCurrent;
+  ElementType element;
+  if (code == MORSE_CHARSPACE && merge) // prosign: next code follows without character space
+    code = 0;
+  if (code == 0) { // current code has finished
+    currentMorse = 0;
+    mergeCurrent = false;
+    word next = nextItem;
+    if (next == 0) return NO_ELEMENT;
+    nextItem = 0;
+    status.accept = ENABLED; // next item moved to current, can accept another one
+    byte type = next >> 8;
+    if (type > ITEM_MERGE) {
+      commandSeconds = next & 0xFF;
+      if (type == ITEM_KEYDOWN) return commandSeconds ? KEYDOWN : NO_ELEMENT; // 0 seconds: nothing to key
+      if (type == ITEM_WAIT) return WAIT;
+      executeItem(type, next & 0xFF);
+      return NO_ELEMENT;
+    }
+    code = next & 0xFF; // fetch next
+    merge = (type == ITEM_MERGE);
+    currentAscii = nextAscii;
+  }
+  switch (code) {
+    case MORSE_SPACE :
+      element = WORDSPACE;
+      code = 0; // remove the explicit space code
+      break;
+    case MORSE_CHARSPACE:
+      element = CHARSPACE; // same as above, but shorter
+      code = 0;
+      break;
+    default:
+      element = ((code & 0x80) == 0) ? DIT : DAH;
+      code <<= 1; // shift to next element
+  }
+  currentMorse = code;
+  mergeCurrent = merge;
+  ascii = currentAscii; // first element of the character carries its echo
+  currentAscii = 0;
+  return element; // speed change behind this code waits until the element is timed, see fillQueue()
+}
+
+/**
+ * Expand buffered codes and commands into element queue as far as it has room. Element durations
+ * are computed here from the timing profile in effect at that position of the text, so neither
+ * character encoding nor speed changes stand between two elements on the air.
+ */
+void KeyingInterface::fillQueue()
+{
+  while (status.breakIn == OFF && (currentMorse != 0 || nextItem != 0)) {
+    reportStarted(queueHead); // entry is reused only after its character has been echoed
+    if ((byte)(queueTail - echoHead) >= queueSize) break;
+    byte ascii;
+    ElementType element = nextBufferElement(ascii); // every call consumes something, at most one entry is queued
+    if (element != NO_ELEMENT) queueElement(element, PTT_KEEP, ascii);
+  }
+}
+
+/**
+ * Append element to element queue, caller checks there is room
+ * @param element element to queue, NO_ELEMENT for PTT switch alone
+ * @param ptt PTT level to switch before the element starts, PTT_KEEP = no change
+ * @param ascii character to echo when the element starts, zero = none
+ */
+void KeyingInterface::queueElement(ElementType element, byte ptt, byte ascii)
+{
+  QueuedElement &e = elementQueue[queueTail & (queueSize - 1)];
+  e.element = element;
+  e.ptt = ptt;
+  e.ascii = ascii;
+  e.markUs = 0;
+  e.spaceUs = 0;
+  if (element != NO_ELEMENT) elementTiming(element, e.markUs, e.spaceUs);
+  queueTail++; // single byte store publishes the complete entry to the consumer
+}
+
+/**
+ * Take next element from element queue, PTT switches queued before it are executed on the way.
+ * Called from timer interrupt in hardware timer mode; status.ptt follows in service().
+ * @param e returns the element
+ * @return false if there is no element to start
+ */
+bool KeyingInterface::takeQueued(QueuedElement &e)
+{
+  while (queueHead != queueTail) {
+    e = elementQueue[queueHead & (queueSize - 1)];
+    queueHead++;
+    if (e.ptt != PTT_KEEP) PttLine1::write(flags.ptt == ENABLED ? e.ptt : LOW);
+    if (e.element != NO_ELEMENT) return true;
+  }
+  return false;
+}
+
+/**
+ * Serial echo of buffered text: characters whose first element has been taken from the queue, i.e. is on the air,
+ * are passed to echo listener in order. Called from main loop only, interrupt just moves queueHead.
+ * @param head queue index of the first entry not started
+ */
+void KeyingInterface::reportStarted(byte head)
+{
+  while (echoHead != head) {
+    byte ascii = elementQueue[echoHead & (queueSize - 1)].ascii;
+    echoHead++;
+    if (ascii != 0 && echoListener != nullptr) echoListener(ascii);
+  }
+}
+
+void KeyingInterface::setEchoListener(void (*listener)(byte ascii)) { echoListener = listener; }
+
+void KeyingInterface::clearQueue()
+{
+  halNoInterrupts();
+  byte head = queueHead; // elements before it have started
+  queueHead = queueTail;
+  halInterrupts();
+  reportStarted(head);
+  echoHead = queueTail; // dropped elements are not echoed
+}
+
+/**
+ * Drop buffered codes and queued elements not started yet, the element in progress is finished
+ */
+void KeyingInterface::clearBuffer()
+{
+  clearQueue();
+  currentMorse = 0;
+  nextItem = 0;
+  currentAscii = 0;
+  nextAscii = 0;
+  mergeCurrent = false;
+  status.accept = ENABLED;
+}
+
+/**
+ * Buffered speed change is executed as soon as the current code has no more elements to start.
+ * Durations of elements already started are not affected, so the change happens exactly at character boundary.
+ */
+void KeyingInterface::executeTimingItem()
+{
+  if (currentMorse != 0 || (nextItem >> 8) < ITEM_WPM)
+    return;
+  executeItem(nextItem >> 8, nextItem & 0xFF);
+  nextItem = 0;
+  status.accept = ENABLED;
+}
+
+/**
+ * @param lpm100 HSCW speed in hundreds of letters (PARIS) per minute, i.e. unit = 6 s / lpm
+ * @return timing unit in 1/16 us
+ */
+static unsigned long hscwUnitFx(byte lpm100)
+{
+  return (6000000UL << TIMING_FRACTION_BITS) / (lpm100 * 100UL);
+}
+
+/**
+ * Execute buffered command
+ * @param type item type, see KeyerItemType
+ * @param value command parameter
+ */
+void KeyingInterface::executeItem(byte type, byte value)
+{
+  switch (type) {
+    case ITEM_PTT:
+      queueElement(NO_ELEMENT, value ? ON : OFF); // switched by the element train, not now
+      break;
+    case ITEM_WPM:
+      if (value >= 5) {
+        setProfileUnit(COMMAND_SPEED, (1200000UL << TIMING_FRACTION_BITS) / value);
+        commandSpeed = true;
+      }
+      break;
+    case ITEM_HSCW:
+      if (value > 0) {
+        setProfileUnit(COMMAND_SPEED, hscwUnitFx(value));
+        commandSpeed = true;
+      }
+      break;
+    case ITEM_CANCEL_SPEED:
+      commandSpeed = false; // back to buffered text speed
+      break;
+  }
 }
 
 /**
@@ -202,9 +470,11 @@ void KeyingInterface::sendPaddleElement(byte input)
   // i.e. special handling of squeeze to detect which paddle was added
   if (status.mode == ULTIMATIC)
   {
-    input = (paddleMemUltimatic ^ input) & input;
-    // at this point {input} is one of DOT, DAH, PADDLE_FREE
-    paddleMemUltimatic = input;
+    if (input != PADDLE_SQUEEZE)
+      paddleMemUltimatic = input; // single paddle or none: remember it
+    else if (paddleMemUltimatic != PADDLE_FREE)
+      input = PADDLE_SQUEEZE & ~paddleMemUltimatic; // squeeze: the paddle pressed last wins
+    // at this point {input} is one of DOT, DAH, PADDLE_FREE, or squeeze when both were pressed at once
   }
   // in case of IAMBIC B, substitute no paddle contact by paddle memory
   else if (status.mode == IAMBIC_B && input == PADDLE_FREE) // use memory in case of Iambic B status.mode
@@ -216,7 +486,7 @@ void KeyingInterface::sendPaddleElement(byte input)
   // next element is determined accordingly
   switch (input)
   {
-  case 3: // squeeze; after previous transformation, ultimatic will never have 3
+  case 3: // squeeze
     nextElement = (internal.last == DIT) ? DAH : DIT;
     break;
   case 0:
@@ -229,6 +499,14 @@ void KeyingInterface::sendPaddleElement(byte input)
   sendElement(nextElement); // set next element to be sent
 }
 
+void KeyingInterface::setHscwSpeed(byte lpm100)
+{
+  if (lpm100 > 0) {
+    bufferFollowsPaddles = false;
+    setProfileUnit(BUFFER_SPEED, hscwUnitFx(lpm100));
+  }
+}
+
 void KeyingInterface::setFirstExtension(byte ms)
 {
   if( ms <= 250 ) firstExtension = ms;
@@ -236,7 +514,11 @@ void KeyingInterface::setFirstExtension(byte ms)
 
 void KeyingInterface::setQskCompensation(byte ms)
 {
-  if (ms <= 250 ) qskCompensation = ms;
+  if (ms <= 250 ) {
+    qskCompensation = ms;
+    for (byte i = 0; i < SPEED_PROFILES; i++)
+      computeProfile(i);
+  }
 }
 
 /**
@@ -246,11 +528,11 @@ void KeyingInterface::setQskCompensation(byte ms)
 void KeyingInterface::setKey(OnOffEnum onOff)
 {
   if( flags.key == ENABLED ) {
-    digitalWrite(pin_keyline1, onOff);
+    KeyLine1::write(onOff);
     status.key = onOff;
   } 
   else {
-    digitalWrite(pin_keyline1, LOW);
+    KeyLine1::low();
     status.key = OFF ;
   }
 }
@@ -263,14 +545,15 @@ void KeyingInterface::setKey(OnOffEnum onOff, word timeout)
 {
   if (flags.key == ENABLED || timeout > 0)
   {
-    digitalWrite(pin_keyline1, onOff);
+    KeyLine1::write(onOff);
     status.key = onOff;
     status.force = ON ;
-    hardKeyTimeout = currentTime + timeout ;
+    hardKeyStart = currentTime ;
+    hardKeyTimeout = timeout ;
   }
   else
   {
-    digitalWrite(pin_keyline1, LOW);
+    KeyLine1::low();
     status.key = OFF;
     status.force = OFF ;
   }
@@ -286,17 +569,66 @@ void KeyingInterface::setMode(KeyerMode newMode)
   paddleMemory = 0;
 }
 
+/**
+ * Set paddle switchpoint: paddle memory for the next element is armed this percent of unit
+ * after the mark of the current element ends. Zero arms the memory right at mark end.
+ * @param percent 0 to 100
+ */
+void KeyingInterface::setPaddleSwitchpoint(byte percent)
+{
+  if (percent <= 100) paddleSwitchpoint = percent;
+}
+
+/**
+ * Record paddle press captured by paddle interrupt into paddle memory. The press counts only
+ * if it happened after paddle memory of the current element was armed, see setPaddleSwitchpoint().
+ * @param pressed paddles pressed, PADDLE_DIT | PADDLE_DAH
+ * @param us micros() of the press
+ */
+void KeyingInterface::recordPaddle(byte pressed, unsigned long us)
+{
+  if (status.source == SRC_PADDLE && status.busy == BUSY && (long)(us - memoryArmUs) >= 0)
+    paddleMemory = paddleMemory | pressed;
+}
+
+/**
+ * Paddle pressed, called from paddle interrupt. While buffered text is being sent, the key line
+ * is released at once; service() then completes the break-in with the same paddle press.
+ */
+void KeyingInterface::paddleBreakIn()
+{
+  if (!breakInArmed) return;
+  breakInArmed = false;
+#if defined(CONFIG_KEYING_HW_TIMER)
+  elementTimer.stop();
+  timerPhase = TIMER_IDLE;
+#endif
+  KeyLine1::low();
+}
+
+/**
+ * Pause buffered sending. The element in progress is finished, queued elements and the rest
+ * of the current character are sent after resume. Paddles can be used while paused.
+ * @param pause true = pause, false = resume
+ */
+void KeyingInterface::setPause(bool pause)
+{
+  paused = pause; // timer interrupt does not start the next element while paused
+  if (!paused && (queueHead != queueTail || currentMorse != 0 || nextItem != 0))
+    status.source = SRC_BUFFER; // continue where it stopped
+}
+
 /**
  * @param level - high or low
 */
 void KeyingInterface::setPtt(OnOffEnum onOff)
 {
   if( flags.ptt == ENABLED ) {
-    digitalWrite(pin_pttline1, onOff);
+    PttLine1::write(onOff);
     status.ptt = onOff ;
   }
   else {
-    digitalWrite(pin_pttline1, LOW);
+    PttLine1::low();
     status.ptt = OFF ;
   }
 }
@@ -310,9 +642,12 @@ void KeyingInterface::setPttTiming( byte lead, byte tail ) {
 void KeyingInterface::setTone(word hz)
 {
   hz = trimToneFreq(hz) ;
-  if( hz > 0)
-    tone(pin_sidetone, hz); 
-  else noTone(pin_sidetone);
+  toneActive = (hz > 0);
+  if( hz > 0) {
+    if (hz != sidetone.getFrequency()) sidetone.setFrequency(hz); // divider is cached for the usual toneFreq
+    sidetone.on();
+  }
+  else sidetone.off();
 }
 
 /**
@@ -329,18 +664,69 @@ void KeyingInterface::setSource(KeyingSource s)
  */
 void KeyingInterface::setToneFreq( word hz ) {
   hz = trimToneFreq(hz);
-  if( hz > 0 ) toneFreq = hz ;
+  if( hz > 0 ) {
+    toneFreq = hz ;
+    sidetone.setFrequency(hz); // compute divider now, not at every element
+  }
 }
 
-void KeyingInterface::setTimingParameters( byte wpm, word _dahRatio, word _weighting ) {
-  unit = (wpm > 5) ? 1200 / wpm : unit ;
+/**
+ * Set speed of one timing profile. Element in progress keeps its timing, the new speed applies
+ * from the next element of that source.
+ * @param profile PADDLE_SPEED, BUFFER_SPEED or COMMAND_SPEED
+ * @param wpm speed; for BUFFER_SPEED zero means the same speed as paddles
+ */
+void KeyingInterface::setSpeed(SpeedControlMode profile, byte wpm) {
+  if (profile == BUFFER_SPEED && wpm == 0) {
+    bufferFollowsPaddles = true;
+    profiles[BUFFER_SPEED] = profiles[PADDLE_SPEED];
+    return;
+  }
+  if (wpm < 5) return; // Winkeyer range is 5 to 99 WPM
+  if (profile == BUFFER_SPEED) bufferFollowsPaddles = false;
+  setProfileUnit(profile, (1200000UL << TIMING_FRACTION_BITS) / wpm);
+}
+
+/**
+ * Set DAH:DIT ratio and weighting, common to all profiles
+ * @param _dahRatio DAH duration in percent of DIT, 0 = keep
+ * @param _weighting DIT duration in percent of unit, 0 = keep
+ */
+void KeyingInterface::setTimingParameters( word _dahRatio, word _weighting ) {
   ditDahFactor = (_dahRatio == 0) ? ditDahFactor : _dahRatio;
   weighting = (_weighting == 0) ? weighting : _weighting;
+  for (byte i = 0; i < SPEED_PROFILES; i++)
+    computeProfile(i);
+}
+
+void KeyingInterface::setProfileUnit(byte profile, unsigned long unitFx) {
+  profiles[profile].unitFx = unitFx;
+  computeProfile(profile);
+  if (profile == PADDLE_SPEED && bufferFollowsPaddles)
+    profiles[BUFFER_SPEED] = profiles[PADDLE_SPEED];
+}
+
+/**
+ * Precompute element durations of a profile from its unit, weighting, ratio and QSK compensation.
+ * This is the only place where element timing is multiplied and divided.
+ */
+void KeyingInterface::computeProfile(byte profile) {
+  TimingProfile &p = profiles[profile];
+  unsigned long dit = (p.unitFx * weighting) / 50UL; // DIT duration with weighting
+  unsigned long qsk = (qskCompensation * 1000UL) << TIMING_FRACTION_BITS;
+  p.spaceFx = 2 * p.unitFx - dit;                    // element space duration with weighting
+  // QSK compensation moves key down edge earlier: mark gets longer, space shorter, speed stays the same
+  p.spaceFx = (p.spaceFx > qsk + (p.unitFx >> 2)) ? p.spaceFx - qsk : p.unitFx >> 2; // keep 1/4 unit key up
+  p.markFx[0] = dit + qsk;
+  p.markFx[1] = (dit * ditDahFactor) / 100UL + qsk;  // DAH: multiply by ditDahFactor
 }
 
 KeyerState KeyingInterface::handleBreakIn() {
   // common for all breaks:
   // stop sending:
+#if defined(CONFIG_KEYING_HW_TIMER)
+  startTimer(0, profiles[activeProfile].unitFx >> TIMING_FRACTION_BITS); // first cancel interrupt timing, then leave 1T to handle paddle break in the main loop
+#endif
   setKey(OFF);
   setTone(0);
   // clear element buffers & timer
@@ -348,13 +734,11 @@ KeyerState KeyingInterface::handleBreakIn() {
   internal.last = NO_ELEMENT;
   onTimer = 0;
   status.force = OFF;
-  offTimer = unit; // leave 1T to handle paddle break in the main loop
+  offTimer = profiles[activeProfile].unitFx >> TIMING_FRACTION_BITS; // leave 1T to handle paddle break in the main loop
   // Buffer specific:
   if (status.source == SRC_BUFFER)
   {
-    // clear morse codes
-    currentMorse = 0;
-    nextMorse = 0;
+    clearBuffer(); // clear morse codes and elements expanded from them
     // set break-in status, it has to be reported to protocol
     status.breakIn = ON;
     status.accept = DISABLED; // do not accept further codes until breakIn is cleared
@@ -367,12 +751,12 @@ KeyerState KeyingInterface::handleBreakIn() {
 */
 KeyerState KeyingInterface::service( byte paddleState ) {
   // check current time 
-  unsigned long interval = currentTime - lastMillis ; 
+  unsigned long interval = currentMicros - lastMicros ; // unsigned difference is safe across micros() wraparound
   // (1) check paddle break and hard keydown timeout. Breaks buffer send and forced keydown. 
   // Break-in condition is asynchronous = it does not depend on timing
   // therefore it is checked before checking timers
   bool breakInFlag =  paddleState > 0 && (status.source == SRC_BUFFER && status.busy == BUSY);
-  bool forceTimeoutFlag = (hardKeyTimeout <= currentTime && status.force == ON); 
+  bool forceTimeoutFlag = (status.force == ON && (currentTime - hardKeyStart) >= hardKeyTimeout); 
   if ( breakInFlag || forceTimeoutFlag || (status.force == ON && paddleState > 0))
   {
     return handleBreakIn(); // do all necessary actions and return new status
@@ -381,14 +765,18 @@ KeyerState KeyingInterface::service( byte paddleState ) {
   if( interval == 0UL ) return status ; // timing in progress, but elapsed zero time, hence no change
   //  if( nextMorse == 0 && !status.breakIn) status.buffer = ENABLED ;
   // (3-4) check paddle word space
-  if (morseCollected == 0 &&  (collectionTimeout > 0) && (currentTime > collectionTimeout) )
+  if (morseCollected == 0 &&  (collectionTimeout > 0) && (currentMicros - collectionStart > collectionTimeout) )
   {
     collectionTimeout = 0;   // stop word space timer
     morseCollected = 0xFFFF; // explicit code representing word space
     status.hasPaddleCode = YES;
   }
-  lastMillis = currentTime ; // remember new current time
+  lastMicros = currentMicros ; // remember new current time
   if( status.source == SRC_BUFFER ) morseCollector = 0;
+#if defined(CONFIG_KEYING_HW_TIMER)
+  // (2-3) key edges are switched by timer interrupt, only follow its events
+  if (!serviceTimerEvents(paddleState)) return status; // element in progress, no other action is possible
+#else
   // (2) service KEY DOWN state
   if( onTimer > 0UL ) {
     if (onTimer < interval) onTimer = 0;
@@ -396,13 +784,13 @@ KeyerState KeyingInterface::service( byte paddleState ) {
     if (onTimer == 0) { // KEY DOWN just finished:
       setKey(OFF);                // switch off key line
       setTone(0);                 // switch off sidetone
-      paddleMemory = PADDLE_FREE; // clear paddle memory for Iambic B
     }
     return status; // element in progress, no other action is possible
   }
   // (3) service KEY UP state
   if (offTimer > 0) {
-    paddleMemory = paddleMemory | paddleState; // record paddle state for Iambic B
+    if ((long)(currentMicros - memoryArmUs) >= 0)
+      paddleMemory = paddleMemory | paddleState; // record paddle state for Iambic B
     if (offTimer < interval) offTimer = 0;
     else offTimer = offTimer - interval;
     if (offTimer == 0) { // if just finished pause
@@ -421,51 +809,166 @@ KeyerState KeyingInterface::service( byte paddleState ) {
     }
     else { return status ; } // if pause is in progress, no more actions follow
   }
+#endif
 
   // (4) service buffered morse code 
   // The section above just finished element pause, so serve next element
   if (status.source == SRC_BUFFER && status.busy == READY) {
-    if (currentMorse == 0) { // current code has finished
-      if (nextMorse != 0) { // fetch next
-        currentMorse = nextMorse;
-        nextMorse = 0; // clear FIFO
-        status.accept = ENABLED;
-      }
-      // otherwise switch to paddle mode if no more codes in buffer
-      else { 
-        status.source = SRC_PADDLE; 
-        sendElement(NO_ELEMENT);
-      } // switch to paddle if no more morse codes
-    }
-    // now handle non-empty morse codes
-    switch (currentMorse) {
-      // case 0: break; // this is redundant, handled above!
-      case MORSE_SPACE :
-        sendElement( WORDSPACE );
-        currentMorse = 0 ; // remove the explicit space code
-        break ;
-      case MORSE_CHARSPACE:
-        sendElement( CHARSPACE ); // same as above, but shorter
-        currentMorse = 0 ;
-        break ;
-      default:
-        ElementType e = ((currentMorse & 0x80) == 0) ? DIT : DAH;
-        sendElement(e); // prepare next element and continue to timing section
+    QueuedElement e;
+    fillQueue();
+    bool started = !paused && takeQueued(e);
+    reportStarted(queueHead);
+    status.ptt = PttLine1::read() ? ON : OFF; // PTT may have been switched by queue
+    if (!started) { // switch to paddle mode if no more codes in buffer
+      status.source = SRC_PADDLE;
+      sendElement(NO_ELEMENT);
     }
-    currentMorse <<= 1; // shift to next element
+    else startElement((ElementType)e.element, e.markUs, e.spaceUs); // continue to timing section
   }
   if( status.source == SRC_BUFFER ) {
-    digitalWrite( LED_BUILTIN, HIGH ); // signal buffer busy
+    BufferLed::high(); // signal buffer busy
     return status; // if sending buffer, we don't check paddles
   } 
   // (5) last action: check paddles and play element if paddles pressed
   // as a result of previous actions, at this point status must be READY
   // and source must be PADDLE
-  digitalWrite(LED_BUILTIN, LOW);
+  BufferLed::low();
   sendPaddleElement(paddleState);
   return status ; // always return status to allow for proper interaction with other components
 }
 
+/**
+ * Report deadlines of the current state to scheduler: element end (polling mode only, timer interrupt
+ * wakes the CPU otherwise), hard key timeout and paddle word space detection.
+ * Also arm paddle interrupt break-in for the buffered sending in progress.
+ */
+void KeyingInterface::schedule()
+{
+  breakInArmed = (status.source == SRC_BUFFER && status.busy == BUSY && status.breakIn == OFF);
+#if !defined(CONFIG_KEYING_HW_TIMER)
+  if (onTimer > 0UL) scheduler.wakeAt(lastMicros + onTimer);
+  else if (offTimer > 0UL) scheduler.wakeAt(lastMicros + offTimer);
+#endif
+  if (status.force == ON) {
+    unsigned long elapsed = currentTime - hardKeyStart;
+    scheduler.wakeAt(currentMicros + ((elapsed < hardKeyTimeout) ? (hardKeyTimeout - elapsed) * 1000UL : 0UL));
+  }
+  if (morseCollected == 0 && collectionTimeout > 0)
+    scheduler.wakeAt(collectionStart + collectionTimeout + 1);
+}
+
+#if defined(CONFIG_KEYING_HW_TIMER)
+/**
+ * Start hardware timing of the element just set up by startElement(). Queued elements follow it.
+ * @param markUs key down time, zero for spaces
+ * @param spaceUs key up time following the mark
+ */
+void KeyingInterface::startTimer(unsigned long markUs, unsigned long spaceUs)
+{
+  halNoInterrupts();
+  startedElement = NO_ELEMENT;
+  timerEvents = 0;
+  if (markUs > 0) {
+    timerPhase = TIMER_MARK;
+    timerSpaceUs = spaceUs;
+    elementTimer.start(markUs);
+  }
+  else if (spaceUs > 0) {
+    timerPhase = TIMER_SPACE;
+    elementTimer.start(spaceUs);
+  }
+  else {
+    timerPhase = TIMER_IDLE;
+    elementTimer.stop();
+  }
+  halInterrupts();
+}
+
+/**
+ * Timer interrupt handler, called exactly at the end of mark or space. At mark end it releases
+ * the key line, at space end it starts the next queued element, so that buffered elements follow
+ * each other without any loop-induced delay. Sidetone and status follow in service().
+ */
+void KeyingInterface::timerDeadline()
+{
+  scheduler.signal(); // service() has to follow the events
+  if (timerPhase == TIMER_MARK) {
+    KeyLine1::low();
+    timerEvents |= TIMER_EV_MARK_END;
+    timerPhase = TIMER_SPACE;
+    elementTimer.next(timerSpaceUs);
+    return;
+  }
+  timerEvents |= TIMER_EV_SPACE_END;
+  QueuedElement e;
+  if (paused || !takeQueued(e)) {
+    timerPhase = TIMER_IDLE; // nothing queued, service() takes over
+    return;
+  }
+  startedElement = (ElementType)e.element;
+  timerEvents |= TIMER_EV_STARTED;
+  if (e.markUs > 0) {
+    if (flags.key == ENABLED) KeyLine1::high();
+    timerPhase = TIMER_MARK;
+    timerSpaceUs = e.spaceUs;
+    elementTimer.next(e.markUs);
+  }
+  else {
+    timerPhase = TIMER_SPACE;
+    elementTimer.next(e.spaceUs);
+  }
+}
+
+/**
+ * Process events reported by timer interrupt: update status and sidetone, record paddle memory
+ * and refill element queue.
+ * @param paddleState current paddle state
+ * @return true when no element is in progress, i.e. keyer is ready for the next one
+ */
+bool KeyingInterface::serviceTimerEvents(byte paddleState)
+{
+  halNoInterrupts();
+  byte events = timerEvents;
+  TimerPhase phase = timerPhase;
+  ElementType started = startedElement;
+  timerEvents = 0;
+  startedElement = NO_ELEMENT;
+  halInterrupts();
+  reportStarted(queueHead); // echo characters started by interrupt
+  if (events & TIMER_EV_STARTED) {
+    internal.last = internal.current;  // record completed element to memory
+    internal.current = started;
+    status.busy = BUSY;
+    paddleMemory = PADDLE_FREE;
+  }
+  if (events != 0 || phase != TIMER_IDLE) {
+    // key line was switched by interrupt: follow it with status and sidetone
+    bool mark = (phase == TIMER_MARK);
+    status.key = (mark && flags.key == ENABLED) ? ON : OFF;
+    if (mark != toneActive) setTone(mark ? toneFreq : 0);
+    status.ptt = PttLine1::read() ? ON : OFF; // PTT may have been switched by queue
+  }
+  if (phase == TIMER_SPACE && (long)(currentMicros - memoryArmUs) >= 0)
+    paddleMemory = paddleMemory | paddleState; // record paddle state for Iambic B
+  if (phase != TIMER_IDLE) {
+    fillQueue();
+    return false;
+  }
+  if (status.busy == BUSY) { // element just finished
+    internal.last = internal.current;
+    internal.current = NO_ELEMENT;
+    status.busy = READY;
+  }
+  // clear break-in status if still active
+  if (status.breakIn == ON) {
+    status.breakIn = OFF;
+    status.accept = ENABLED;
+    status.source = SRC_PADDLE;
+  }
+  return true;
+}
+#endif
+
 /**
  * @param hz required sidetone frequency
  * @returns sidetone frequency trimmed to remain between limits
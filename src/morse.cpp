@@ -21,13 +21,15 @@ MorseEngine morse = MorseEngine();
  * Code is interpreted by reading MSB, then shift left. Bit value 1 means DAH, bit value 0 means DIT.
  * Width is limited by 8 bits. Maximum possible code length is hence 7 elements.
  *
+ * The table is stored in flash, read it with pgm_read_byte() only.
+ *
  * This code table is based on recommendation ITU-R M.1677-1
  * Morse code for exclamation (!) is adopted from https://morsecode.world/international/morse2.html
  * Dollar sign ($), semicolon (;), underscore (_) are copied form somewhere, probably K3NG source code
  * Signals/prosigns: + = AR, & = AS, * = BK, '(' = KN, > = SK should be compatible with K3NG and WinKeyer protocol
  *
  */
-const byte CODE[] = {
+constexpr byte CODE[] PROGMEM = {
     MORSE_SPACE, // space; will send +4T pause, together with 3T charspace = 7T
     0b10101110,  // ! unofficial
     0b01001010,  // " RR
@@ -93,7 +95,28 @@ const byte CODE[] = {
     0,           // ^ caret
     0b001101100, // _ underscore UK, unofficial
 };
-const word CODE_SIZE = sizeof(CODE) / sizeof(CODE[0]);
+constexpr word CODE_SIZE = sizeof(CODE) / sizeof(CODE[0]);
+
+/**
+ * Reverse search in CODE[] evaluated by the compiler: ASCII character for a morse code byte,
+ * '~' if the code is not in the table. As in a linear scan, the first match wins ('+' before '<').
+ */
+constexpr char reverseLookup(byte code, word index = 0)
+{
+  return (code == 0 || index >= CODE_SIZE) ? '~'
+       : (CODE[index] == code)             ? (char)(index + 0x20)
+                                           : reverseLookup(code, index + 1);
+}
+
+#define DECODE4(n) reverseLookup(n), reverseLookup(n + 1), reverseLookup(n + 2), reverseLookup(n + 3)
+#define DECODE16(n) DECODE4(n), DECODE4(n + 4), DECODE4(n + 8), DECODE4(n + 12)
+#define DECODE64(n) DECODE16(n), DECODE16(n + 16), DECODE16(n + 32), DECODE16(n + 48)
+
+/** REVERSE CONVERSION TABLE
+ * Index is MSB-aligned morse code with stop bit (same format as CODE[]), value is ASCII character.
+ * Generated at compile time from CODE[], so the two tables can never disagree. Stored in flash.
+ */
+constexpr char DECODE[256] PROGMEM = {DECODE64(0), DECODE64(64), DECODE64(128), DECODE64(192)};
 
 /**
  * @param ascii ASCII letter to be converted
@@ -110,7 +133,9 @@ byte MorseEngine::asciiToCode(byte ascii)
     ascii -= 0x20;
   // finally, subtract code table offset
   ascii -= 0x20;
-  return (CODE[ascii]);
+  if (ascii >= CODE_SIZE)
+    return 0; // backtick is beyond the table
+  return pgm_read_byte(&CODE[ascii]);
 }
 
 /**
@@ -164,24 +189,21 @@ byte MorseEngine::utf8ToCode(byte prefix, byte utf8Char)
 
 word MorseEngine::adjustCode(word input)
 {
-  word code = input;
   // shift start bit until it appears in high byte, ie. bit 8, ie. 0x0100
-  code = (input << 1) | 1; // shift left and add stop bit
-  while ((code & 0xFF00) == 0)
-    code = code << 1; // shift left until start bit appears in high byte
+  word code = (input << 1) | 1; // shift left and add stop bit
+  // start bit is somewhere in bits 1 to 8: binary search for the shift, always three steps
+  if ((code & 0xFFE0) == 0)
+    code <<= 4;
+  if ((code & 0xFF80) == 0)
+    code <<= 2;
+  if ((code & 0xFF00) == 0)
+    code <<= 1;
   return (code & 0xFF);
 }
 
 byte MorseEngine::lookupCode(word input)
 {
-  int index = 0;
-  int size = sizeof( CODE ) / sizeof (CODE[0]);
-  for(index = 0; index < size ; index++ ) // last element
-  {
-    if( CODE[index] == (byte) input) break ;
-  }
-  if( index < size ) return (index + 0x20) ;
-  return '~' ;
+  return pgm_read_byte(&DECODE[(byte)input]);
 }
 
 /**
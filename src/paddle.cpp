@@ -1,12 +1,66 @@
+#include "hal.h"
 #include "paddle.h"
+#include "keying.h"
+#include "scheduler.h"
+#include "config_speedcontrol.h"
+
+#if !defined(CHALLENGER_NATIVE)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/* Pin change interrupt of the paddle port */
+#if CONFIG_PADDLE_LEFT < 8 && CONFIG_PADDLE_RIGHT < 8
+#define PADDLE_INT_VECTOR PCINT2_vect
+#define PADDLE_INT_MASK_REG PCMSK2
+#define PADDLE_PCIE_MASK (1 << PCIE2)
+#define PADDLE_PORT_FIRST 0
+#elif CONFIG_PADDLE_LEFT > 7 && CONFIG_PADDLE_LEFT < 14 && CONFIG_PADDLE_RIGHT > 7 && CONFIG_PADDLE_RIGHT < 14
+#define PADDLE_INT_VECTOR PCINT0_vect
+#define PADDLE_INT_MASK_REG PCMSK0
+#define PADDLE_PCIE_MASK (1 << PCIE0)
+#define PADDLE_PORT_FIRST 8
+#elif CONFIG_PADDLE_LEFT > 13 && CONFIG_PADDLE_LEFT < 20 && CONFIG_PADDLE_RIGHT > 13 && CONFIG_PADDLE_RIGHT < 20
+#define PADDLE_INT_VECTOR PCINT1_vect
+#define PADDLE_INT_MASK_REG PCMSK1
+#define PADDLE_PCIE_MASK (1 << PCIE1)
+#define PADDLE_PORT_FIRST 14
+#else
+#error "Both paddles must be on the same port (D0-D7, D8-D13 or A0-A5), check config_paddle.h"
+#endif
+
+#if defined(CONFIG_SPEED_TYPE_ROTARY) && (CONFIG_SPEED_ROTARY_CLOCK - PADDLE_PORT_FIRST) >= 0 && (CONFIG_SPEED_ROTARY_CLOCK - PADDLE_PORT_FIRST) < ((PADDLE_PORT_FIRST == 0) ? 8 : 6)
+#error "Rotary encoder and paddles share the same pin change interrupt, move one of them to another port"
+#endif
+
+/**
+ * Enable pin change interrupt of both paddle pins
+ */
+void PaddleInterface::enableInterrupt()
+{
+  PADDLE_INT_MASK_REG |= (1 << (CONFIG_PADDLE_LEFT - PADDLE_PORT_FIRST)) | (1 << (CONFIG_PADDLE_RIGHT - PADDLE_PORT_FIRST));
+  PCICR |= PADDLE_PCIE_MASK;
+}
+
+ISR(PADDLE_INT_VECTOR)
+{
+  paddle.pinChange();
+}
+#endif
 
 /**
  * Initialize paddle interface ports. Mode setting is not included, setMode(newMode) must be 
  * called separately.
  */
 void PaddleInterface::init() {
-  pinMode( pinPaddleRight, INPUT );
-  pinMode( pinPaddleLeft, INPUT );
+  PinPaddleRight::input();
+  PinPaddleLeft::input();
+  halNoInterrupts();
+  edgeHead = edgeTail = 0;
+  acceptedState = readPins();
+  lastEdgeUs[0] = lastEdgeUs[1] = halMicros() - CONFIG_PADDLE_DEBOUNCE_US;
+  halInterrupts();
+  pressed = 0;
+  enableInterrupt();
 }
 
 /**
@@ -17,16 +71,17 @@ void PaddleInterface::swap() {
 }
 
 /**
- * Checks paddle interface ports.
- * If nothing changed, do nothing.
- * Otherwise check if paddles were touched - this will interrupt buffer text send if needed.
- * If in Ultimatic mode, evaluate whether next element has to be changed and change it (special logic). 
- * If in iambic mode, set next element by paddle state, or put opposite to current if squeeze detected.
- * If in iambic A and paddles have no contact, delete element buffer (set next element to NO_ELEMENT)
- * @return updated status
+ * Set swap paddle assignment (Winkeyer mode register bit 3)
  */
-byte PaddleInterface::check() {
-    byte portBits = digitalRead(pinPaddleLeft) * DIT + digitalRead(pinPaddleRight) * DAH ;
+void PaddleInterface::setSwap(bool on) {
+  swapPaddle = on ;
+}
+
+/**
+ * @return paddle contacts as PaddleState, with paddle swap applied
+ */
+byte PaddleInterface::readPins() {
+    byte portBits = PinPaddleLeft::read() * DIT + PinPaddleRight::read() * DAH ;
     portBits = portBits ^ 3 ;
     if( swapPaddle ) {
       portBits = PADDLE_DAH * (portBits & PADDLE_DIT ? 1 : 0) + PADDLE_DIT * (portBits & PADDLE_DAH ? 1 : 0);
@@ -34,4 +89,93 @@ byte PaddleInterface::check() {
     return portBits ;
 }
 
-PaddleInterface paddle; // PaddleInterface singleton instance
\ No newline at end of file
+/**
+ * Pin change interrupt: accept changes of paddles out of their debounce time, queue the new state
+ * with timestamp and cut buffered sending on press.
+ */
+void PaddleInterface::pinChange() {
+  unsigned long now = halMicros();
+  byte state = acceptedState;
+  byte changed = (readPins() ^ state);
+  for (byte i = 0; i < 2; i++) {
+    byte bit = 1 << i;
+    if ((changed & bit) && now - lastEdgeUs[i] >= CONFIG_PADDLE_DEBOUNCE_US) {
+      state ^= bit;
+      lastEdgeUs[i] = now;
+    }
+  }
+  if (state == acceptedState) return; // bounce only
+  if (state & ~acceptedState) keyer.paddleBreakIn(); // paddle pressed
+  acceptedState = state;
+  byte tail = edgeTail;
+  byte next = (tail + 1) & (EDGE_QUEUE_SIZE - 1);
+  if (next != edgeHead) { // queue full: edge is dropped, accepted state is still followed by check()
+    edges[tail].us = now;
+    edges[tail].state = state;
+    edgeTail = next;
+  }
+  scheduler.signal();
+}
+
+/**
+ * Process edges captured by interrupt since the last call.
+ * A paddle contact that ended after a debounce time is picked here from its current level,
+ * because no further interrupt comes to release it.
+ * @return current paddle state, including paddles pressed and already released since the last call
+ */
+byte PaddleInterface::check() {
+    byte taps = 0 ;
+    while (edgeHead != edgeTail) {
+      PaddleEdge &edge = edges[edgeHead] ;
+      if (edge.state & ~lastPaddlePortBits) {
+        pressed |= edge.state & ~lastPaddlePortBits ;
+        pressedUs = edge.us ;
+      }
+      taps |= edge.state ;
+      lastPaddlePortBits = edge.state ;
+      edgeHead = (edgeHead + 1) & (EDGE_QUEUE_SIZE - 1) ;
+    }
+    // follow contact which changed during debounce time of its last edge
+    halNoInterrupts() ;
+    byte level = readPins() ;
+    byte state = acceptedState ;
+    unsigned long now = halMicros() ;
+    for (byte i = 0; i < 2; i++) {
+      byte bit = 1 << i ;
+      if (((level ^ state) & bit) && now - lastEdgeUs[i] >= CONFIG_PADDLE_DEBOUNCE_US) {
+        state ^= bit ;
+        lastEdgeUs[i] = now ;
+        if (state & bit) { pressed |= bit ; pressedUs = now ; }
+      }
+    }
+    acceptedState = state ;
+    halInterrupts() ;
+    lastPaddlePortBits = state ;
+    return state | taps ;
+}
+
+/**
+ * @return paddles pressed since the previous call
+ */
+byte PaddleInterface::takePressed() {
+  byte p = pressed ;
+  pressed = 0 ;
+  return p ;
+}
+
+unsigned long PaddleInterface::getPressTime() { return pressedUs ; }
+
+/**
+ * A contact that changed during the debounce time of its last edge raises no more interrupts,
+ * so the loop has to run once the debounce time is over.
+ */
+void PaddleInterface::schedule() {
+  halNoInterrupts() ;
+  byte changed = readPins() ^ acceptedState ;
+  unsigned long dit = lastEdgeUs[0], dah = lastEdgeUs[1] ;
+  halInterrupts() ;
+  if (changed & PADDLE_DIT) scheduler.wakeAt(dit + CONFIG_PADDLE_DEBOUNCE_US) ;
+  if (changed & PADDLE_DAH) scheduler.wakeAt(dah + CONFIG_PADDLE_DEBOUNCE_US) ;
+}
+
+PaddleInterface paddle; // PaddleInterface singleton instance
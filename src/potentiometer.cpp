@@ -1,40 +1,108 @@
 #include "config_speedcontrol.h"
 
-#if defined(POTENTIOMETER)
+#if defined(CONFIG_SPEED_TYPE_POTENTIOMETER)
 
 #include <Arduino.h>
-#include "pins.h"
-#include "core.h"
-#include "core_variables.h"
 
 #include "potentiometer.h"
+#include "scheduler.h"
 
-#if defined(PIN_POTENTIOMETER) && PIN_POTENTIOMETER > 0
-#define HAS_POTENTIOMETER
+#if !defined(CONFIG_SPEED_POT_INPUT)
+#error "Potentiometer analog input is not defined, check config_speedcontrol.h"
 #endif
 
+static_assert(POT_ADC_BITS + CONFIG_SPEED_POT_OVERSAMPLE <= 16, "Oversampled potentiometer sample does not fit 16 bits");
+
+// shift of the sum of conversions to 16-bit full scale
+#define POT_SCALE_SHIFT (16 - POT_ADC_BITS - CONFIG_SPEED_POT_OVERSAMPLE)
+// one WPM step is 1 << 16 in position units of update()
+#define POT_HYSTERESIS_FX ((CONFIG_SPEED_POT_HYSTERESIS * 65536UL) / 100)
+
 Potentiometer potentiometer = Potentiometer();
 
+// written by ADC interrupt
+static word sampleSum = 0 ;
+static byte sampleCount = 0 ;
+static unsigned long filterState = 0 ;   // filtered position << CONFIG_SPEED_POT_FILTER
+static volatile word filtered = 0 ;      // filtered position, 16-bit full scale
+static volatile bool hasSample = false ; // filter is initialized with the first sample
+
+#if !defined(CHALLENGER_NATIVE)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+/**
+ * Set up ADC: AVcc reference, input CONFIG_SPEED_POT_INPUT, slowest ADC clock,
+ * conversion started by Timer0 overflow, interrupt on conversion complete
+ */
+void Potentiometer::enableInterrupt() {
+  ADMUX = (1 << REFS0) | (CONFIG_SPEED_POT_INPUT & 0x07);
+#if CONFIG_SPEED_POT_INPUT < 6
+  DIDR0 |= (1 << CONFIG_SPEED_POT_INPUT); // digital input buffer is not needed
+#endif
+  ADCSRB = (1 << ADTS2); // auto trigger source: Timer/Counter0 overflow
+  ADCSRA = (1 << ADEN) | (1 << ADATE) | (1 << ADIE) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+}
+
+ISR(ADC_vect)
+{
+  Potentiometer::conversionComplete(ADC);
+}
+#endif
+
 void Potentiometer::init() {
-  #ifdef HAS_POTENTIOMETER
-  pinMode(PIN_POTENTIOMETER, INPUT);
-  value = analogRead(PIN_POTENTIOMETER);
-  value = map(value, 0, POT_FULL_SCALE, minValue, maxValue );
-  #endif
-  lastMeasurementMs = millis() - POT_INTERVAL_MS - 1;
+  hasPosition = false;
+  enableInterrupt();
 }
 
+/**
+ * Map filtered pot position to WPM between minimum and maximum. Leaving the current WPM step requires
+ * going CONFIG_SPEED_POT_HYSTERESIS percent of a step beyond its border. Constant time, no waiting.
+ */
 void Potentiometer::update() {
-  if( millis() - lastMeasurementMs > POT_INTERVAL_MS ) {
-    word measuredValue = 0 ;
-    byte oldValue = value ;
-    lastMeasurementMs = millis();
-    #ifdef HAS_POTENTIOMETER
-    value = analogRead(PIN_POTENTIOMETER);
-    value = map( measuredValue, 0, POT_FULL_SCALE, minValue, maxValue );
-    #endif
-    hasChanged = ( oldValue != value ); 
+  if (!hasSample) return;
+  word position;
+  do {
+    position = filtered;
+  } while (position != filtered); // interrupt may come between reading the two bytes
+  byte range = maxValue - minValue + 1;
+  unsigned long scaled = (unsigned long)position * range; // integer part (bits 16+) is the step
+  int step = scaled >> 16;
+  int current = value - minValue;
+  if (!hasPosition || current < 0 || current >= range) {
+    hasPosition = true;
+    current = step;
+  }
+  else if (step > current && scaled >= POT_HYSTERESIS_FX) {
+    step = (scaled - POT_HYSTERESIS_FX) >> 16;
+    if (step > current) current = step;
+  }
+  else if (step < current) {
+    step = (scaled + POT_HYSTERESIS_FX) >> 16;
+    if (step < current) current = step;
   }
+  value = minValue + current;
 }
 
-#endif
\ No newline at end of file
+/**
+ * Conversion complete, called from ADC interrupt: sum conversions, then filter the sum and publish it
+ * @param adc conversion result
+ */
+void Potentiometer::conversionComplete(word adc)
+{
+  sampleSum += adc;
+  if (++sampleCount < (1 << CONFIG_SPEED_POT_OVERSAMPLE)) return;
+  word sample = sampleSum << POT_SCALE_SHIFT;
+  sampleSum = 0;
+  sampleCount = 0;
+  if (!hasSample) filterState = (unsigned long)sample << CONFIG_SPEED_POT_FILTER;
+  else filterState = filterState - (filterState >> CONFIG_SPEED_POT_FILTER) + sample;
+  word position = filterState >> CONFIG_SPEED_POT_FILTER;
+  if (position != filtered || !hasSample) {
+    filtered = position;
+    hasSample = true;
+    scheduler.signal(); // speed value to be updated in main loop
+  }
+}
+
+#endif
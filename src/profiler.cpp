@@ -0,0 +1,76 @@
+#include "hal.h"
+#include "profiler.h"
+
+#if defined(CONFIG_LOOP_PROFILER)
+
+LoopProfiler profiler; // profiler singleton
+
+/**
+ * Clear all histograms and overrun counter
+ */
+void LoopProfiler::reset()
+{
+  memset(histogram, 0, sizeof(histogram));
+  overruns = 0;
+}
+
+void LoopProfiler::setDeadline(word us) { deadline = us; }
+
+word LoopProfiler::getDeadline() { return deadline; }
+
+word LoopProfiler::getOverruns() { return overruns; }
+
+const LatencyHistogram &LoopProfiler::getHistogram(ProfiledSection section)
+{
+  return histogram[section < PROF_SECTIONS ? section : PROF_LOOP];
+}
+
+/**
+ * Put latency sample into its log2 bucket and update maximum. All counters saturate instead of wrapping.
+ * @param section profiled section
+ * @param us measured latency in microseconds
+ */
+void LoopProfiler::record(ProfiledSection section, unsigned long us)
+{
+  LatencyHistogram &h = histogram[section];
+  word sample = (us > 0xFFFF) ? 0xFFFF : us;
+  byte bucket = 0;
+  while (sample >= 4 && bucket < PROF_BUCKETS - 1)
+  {
+    sample >>= 1;
+    bucket++;
+  }
+  if (h.count[bucket] < 0xFFFF)
+    h.count[bucket]++;
+  if (us > h.max)
+    h.max = (us > 0xFFFF) ? 0xFFFF : us;
+}
+
+void LoopProfiler::startLoop()
+{
+  loopStart = halMicros();
+}
+
+void LoopProfiler::endLoop()
+{
+  unsigned long us = halMicros() - loopStart;
+  record(PROF_LOOP, us);
+  if (deadline > 0 && us > deadline && overruns < 0xFFFF)
+    overruns++;
+}
+
+void LoopProfiler::start()
+{
+  sectionStart = halMicros();
+}
+
+void LoopProfiler::stop(ProfiledSection section)
+{
+  record(section, halMicros() - sectionStart);
+}
+
+#else
+
+LoopProfiler profiler; // empty profiler singleton
+
+#endif
\ No newline at end of file
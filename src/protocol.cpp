@@ -1,15 +1,25 @@
 // #include <Arduino.h>
 #include "config_protocol.h"
+#include "hal.h"
 #include "speed_control.h"
 #include "morse.h"
 #include "keying.h"
 #include "paddle.h"
 #include "protocol.h"
+#include "profiler.h"
+#include "tx_scheduler.h"
+#include "scheduler.h"
+#include "settings.h"
 
 const word WINKEY_SIDETONE_FREQ = 4000;
+const byte WINKEY_EEPROM_MAGIC = 0xA5; // first byte of Winkeyer EEPROM image
+const word WINKEY_EEPROM_SIZE = 256;
 
-const byte BUFFER_XOFF_LIMIT = 4;
-const byte BUFFER_XON_LIMIT = 16;
+// flow control thresholds in free bytes: 4 and 16 up to 256 bytes of buffer capacity, scaled up above
+const word BUFFER_XOFF_LIMIT = (TextBuffer::SIZE < 256) ? 4 : TextBuffer::SIZE / 64;
+const word BUFFER_XON_LIMIT = (TextBuffer::SIZE < 256) ? 16 : TextBuffer::SIZE / 16;
+
+const byte AUTOBAUD_HOLD_MS = 50; // after baud rate switch, ignore the rest of bytes host sent at the other rate
 
 const byte WKS_READY = 0xC0;    // send to report everything OK and also after WKS_BREAKIN (to make N1MM happy)
 const byte WKS_BUFFERED = 0xC4; // send when accepted first character to buffer
@@ -17,19 +27,11 @@ const byte WKS_XOFF = 0xC5;     // send when buffer almost full (fifo.getFree()
 const byte WKS_XON = 0xC4;      // send when in XOFF condition and fifo.getFree() > BUFFER_XON_LIMIT
 const byte WKS_BREAKIN = 0xC6;  // send on paddle break-in event (must be followed by 0xC0)
 
-/*
- * Jumping to 0x0000 will restart the whole program
- */
-void reboot_cpu()
-{
-  void (*reboot)() = 0x0000;
-  (*reboot)();
-}
-
 // Parameter size table for Winkeyer commands.
 // for regular commands 0x01 through to 0x1F: index = command code. Index zero is not valid.
 // for admin commands, offset is 0x20, i.e. [0x20] => command <0> <0>
-const byte parametersExpected[] = {
+// Stored in flash, read by paramCount().
+const byte parametersExpected[] PROGMEM = {
     0, 1, 1, 1,  // n/a, sidetone, wpm, weighting
     2, 3, 1, 0,  // ptt delays, pot range, pause morse, request pot value
     0, 1, 0, 1,  // backup input pointer, set output pin, clear buffer, key immediate
@@ -44,11 +46,20 @@ const byte parametersExpected[] = {
 
     3, 0, 0, 0, // calibrate, reset, host open, host close
     1, 0, 0, 0, // echo, -, -, get values
-    0, 0, 0, 0,
-    255, 1};
+    2, 0, 0, 0, // profiler (extension in reserved slot), get cal, wk1 mode, wk2 mode
+    0, 255, 1, 1, // dump EEPROM, load EEPROM (256 bytes), standalone message, load X1MODE
+    0, 0, 0};     // firmware update, low baud (WK3), high baud (WK3)
 
 WinkeyProtocol protocol; // protocol singleton
 
+/**
+ * @return number of parameter bytes expected by command (admin commands with offset 0x20)
+ */
+static byte paramCount(byte command)
+{
+  return pgm_read_byte(&parametersExpected[command]);
+}
+
 /**
  * Execute command fetched in command buffer
  */
@@ -67,7 +78,10 @@ void WinkeyProtocol::executeCommand()
     break;
   // Reset
   case 0x21:
-    reboot_cpu();
+    halReboot();
+    break;
+  case 0x28: // Admin: loop profiler (extension)
+    handleProfilerCommand();
     break;
   // Host Open
   case 0x22:
@@ -77,6 +91,13 @@ void WinkeyProtocol::executeCommand()
   // Host Close
   case 0x23:
     _isHostOpen = false;
+    requestBaud(false); // next host may be WK2 only
+    break;
+  case 0x31: // Admin: set low baud (WK3)
+    requestBaud(false);
+    break;
+  case 0x32: // Admin: set high baud (WK3)
+    requestBaud(true);
     break;
   // Status Mode WK1
   case 0x2A:
@@ -86,69 +107,110 @@ void WinkeyProtocol::executeCommand()
   case 0x2B:
     wkStatusMode = WK2;
     break;
-  // Sidetone Control
-  case 0x01:
-    _sidetonePaddleOnly = (param[0] & 0x80) != 0;
-    param[0] = param[0] & 0x0F;
-    if (param[0] != 0)
+  case 0x2C: // Admin: dump EEPROM, sent by service() as transmitter has room
+    eepromDumpIndex = 0;
+    dumpActive = true;
+    break;
+  case 0x2D: // Admin: load EEPROM, only the defaults block is taken from the image
+    if (param[0] == WINKEY_EEPROM_MAGIC)
     {
-      keyer.setToneFreq(4000 / param[0]);
+      settings.setAll(param + 1);
+      applySettings();
     }
     break;
+  // Sidetone Control
+  case 0x01:
+    settings.set(SETTING_SIDETONE, param[0]);
+    setSidetone(param[0]);
+    break;
   case 0x02: // set WPM
-    keyer.setTimingParameters(param[0]);
+    keyer.setSpeed(BUFFER_SPEED, param[0]); // 0 = paddle speed
     break;
   case 0x03: // set weighting
-    keyer.setTimingParameters(0, 0, param[0]);
+    settings.set(SETTING_WEIGHT, param[0]);
+    keyer.setTimingParameters(0, param[0]);
     break;
   case 0x04: // set PTT head, tail
+    settings.set(SETTING_LEAD, param[0]);
+    settings.set(SETTING_TAIL, param[1]);
     keyer.setPttTiming(param[0], param[1]);
     break;
   case 0x05: // set pot range
+    settings.set(SETTING_MIN_WPM, param[0]);
+    settings.set(SETTING_WPM_RANGE, param[1]);
     speedControl->setMinMax(param[0], param[0] + param[1]);
     break;
+  case 0x06: // pause buffered sending
+    keyer.setPause(param[0] != 0);
+    break;
   case 0x07: // get pot value
-    sendResponse(speedControl->getSpeedWk2());
+    sendPotValue(speedControl->getSpeedWk2());
+    break;
+  case 0x08: // backspace
+    backspace();
+    break;
+  case 0x09: // pin configuration, kept in settings only
+    settings.set(SETTING_PIN_CONFIG, param[0]);
     break;
   case 0x0A:
+    halNoInterrupts(); // receive interrupt may be appending
     fifo.reset();
+    halInterrupts();
+    keyer.clearBuffer(); // keyer holds characters expanded to elements ahead
     break;
   case 0x0B:
     keyer.setKey(ON, 15000);
     break;
+  case 0x0C: // HSCW speed, lpm / 100
+    keyer.setHscwSpeed(param[0]);
+    break;
   case 0x0D:
+    settings.set(SETTING_FARNSWORTH, param[0]);
     keyer.setFarnsworthWpm(param[0]);
     break;
   case 0x0E:
-    setModeParameters();
-    break;
-  // all unimplemented commands w/o response
-  case 0x0F: // load defaults...
-    // TODO: load defaults
-    setModeParameters(); // implicit param[0]
-    keyer.setTimingParameters(param[1], (param[12] * 300U) / 50U, param[3]);
-    keyer.setPttTiming(param[4], param[5]);
-    keyer.setFirstExtension(param[8]);
-    keyer.setQskCompensation(param[9]);
-    speedControl->setValue(param[1]);
-    speedControl->setMinMax(param[6], param[6] + param[7]);
-    keyer.setFarnsworthWpm(param[10]);
+    settings.set(SETTING_MODE, param[0]);
+    setModeParameters(param[0]);
+    break;
+  case 0x0F: // load defaults: the whole settings block
+    settings.setAll(param);
+    applySettings();
+    keyer.setSpeed(BUFFER_SPEED, param[SETTING_SPEED]);
     break;
   case 0x10: // 1st extension
+    settings.set(SETTING_EXTENSION, param[0]);
     keyer.setFirstExtension(param[0]);
     break;
   case 0x11: // QSK compensation
+    settings.set(SETTING_COMPENSATION, param[0]);
     keyer.setQskCompensation(param[0]);
     break;
+  case 0x12: // paddle switchpoint
+    settings.set(SETTING_SWITCHPOINT, param[0]);
+    keyer.setPaddleSwitchpoint(param[0]);
+    break;
   case 0x15: // Winkeyer2 status
     sendStatus();
     break;
+  case 0x16: // buffer pointer
+    handleBufferPointer();
+    break;
   case 0x17: // dah:dit ratio
-    keyer.setTimingParameters(0, (param[0] * 300U) / 50U, 0);
+    settings.set(SETTING_RATIO, param[0]);
+    keyer.setTimingParameters((param[0] * 300U) / 50U, 0);
     break;
-  // buffered commands
+  // buffered commands go into text buffer and are executed when their turn comes
   case 0x18: // buffered PTT
-    // fifo.push(command + 0xF0 * param[0]);
+  case 0x19: // buffered key down
+  case 0x1A: // buffered wait
+  case 0x1B: // merge letters
+  case 0x1C: // buffered WPM
+  case 0x1D: // buffered HSCW
+  case 0x1E: // cancel buffered speed change
+    if (!breakInFlag)
+      fifo.pushTagged(command, param, paramCount(command));
+    break;
+  case 0x1F: // buffered NOP
     break;
   default:
     ignore();
@@ -157,27 +219,65 @@ void WinkeyProtocol::executeCommand()
 }
 
 /**
- * @return {byte} morse code of the next character from buffer, or zero if nothing to send
+ * Convert buffered command taken from text buffer to keyer item
+ * @param tag command code
+ * @return keyer item, see keyerItem()
+ */
+word WinkeyProtocol::bufferedCommandItem(byte tag)
+{
+  byte value = (paramCount(tag) > 0) ? fifo.shift() : 0;
+  switch (tag)
+  {
+  case 0x18:
+    return keyerItem(ITEM_PTT, value);
+  case 0x19:
+    return keyerItem(ITEM_KEYDOWN, value);
+  case 0x1A:
+    return keyerItem(ITEM_WAIT, value);
+  case 0x1B: // first letter is merged with the second one, which stays in buffer as ordinary text
+    value = morse.asciiToCode(value);
+    return (value > 0) ? keyerItem(ITEM_MERGE, value) : 0;
+  case 0x1C:
+    return keyerItem(ITEM_WPM, value);
+  case 0x1D:
+    return keyerItem(ITEM_HSCW, value);
+  case 0x1E:
+    return keyerItem(ITEM_CANCEL_SPEED, 0);
+  }
+  return 0;
+}
+
+/**
+ * @param ascii returns the character for serial echo, which keyer sends back when its first element starts;
+ * zero for buffered commands and characters without morse code (these are echoed at once)
+ * @return {word} morse code of the next character from buffer or buffered command (keyer item),
+ * or zero if nothing to send
  **/
-byte WinkeyProtocol::getNextMorseCode()
+word WinkeyProtocol::getNextMorseCode(byte &ascii)
 {
-  byte c = 0;
+  word c = 0;
+  ascii = 0;
   if (fifo.hasMore())
   {
-    c = fifo.shift(); // returns zero if buffer is empty
-    if (c)
+    c = (byte)fifo.shift(); // returns zero if buffer is empty
+    if (TextBuffer::isTag(c))
+    {
+      c = bufferedCommandItem(c);
+    }
+    else if (c)
     {
+      ascii = c;
       c = morse.asciiToCode(c);
+      if (c == 0)
+      {
+        sendSerialEcho(ascii); // nothing to key
+        ascii = 0;
+      }
     }
     if (fifo.getLength() == 0)
       sendStatus(WKS_READY); // send READY if buffer is empty
-    else
-    {
-      if (bufferFull && fifo.getFree() > BUFFER_XON_LIMIT)
-        sendStatus(WKS_XON); // send XON if buffer was partially freed
-      else
-        sendStatus(WKS_BUFFERED);
-    }
+    else if (!bufferFull)
+      sendStatus(WKS_BUFFERED); // XON is reported by service()
   }
   return c; // return morse code from buffer or zero if no code
 }
@@ -187,7 +287,9 @@ void WinkeyProtocol::handleBreak()
   if (keyState.breakIn == ON && !breakInFlag)
   {
     breakInFlag = true;
+    halNoInterrupts(); // receive interrupt may be appending
     fifo.reset();
+    halInterrupts();
     sendStatus(WKS_BREAKIN);
   }
   if (breakInFlag && keyState.breakIn == OFF)
@@ -217,13 +319,150 @@ void WinkeyProtocol::handleBreak()
 //   }
 // }
 
+/**
+ * Admin command 0x28 (reserved slot used as extension): loop latency profiler.
+ * <00><28><00><xx> report summary: deadline, overruns, number of sections, number of buckets (6 bytes)
+ * <00><28><01><xx> reset all histograms, overrun counter and serial TX drop counters
+ * <00><28><02><nn> set loop deadline to nn * 100 us, zero disables overrun counting
+ * <00><28><03><xx> report serial TX bytes dropped: priority lane, bulk lane (4 bytes), see TxScheduler
+ * <00><28><04><xx> report fraction of time spent in idle sleep in 1/1000 (2 bytes), see TaskScheduler
+ * <00><28><1s><xx> report histogram of section s: max, bucket counts (26 bytes)
+ * All word values are sent little endian. Every response fits into serial TX bulk lane, so nothing is dropped.
+ */
+void WinkeyProtocol::handleProfilerCommand()
+{
+  switch (param[0] & 0xF0)
+  {
+  case 0x00:
+    if (param[0] == 0)
+    {
+      sendWord(profiler.getDeadline());
+      sendWord(profiler.getOverruns());
+      sendResponse(PROF_SECTIONS);
+      sendResponse(PROF_BUCKETS);
+    }
+    else if (param[0] == 1)
+    {
+      profiler.reset();
+      txScheduler.resetDropped();
+      scheduler.resetStats();
+    }
+    else if (param[0] == 2)
+      profiler.setDeadline(param[1] * 100U);
+    else if (param[0] == 3)
+    {
+      sendWord(txScheduler.getDropped(TX_PRIORITY));
+      sendWord(txScheduler.getDropped(TX_BULK));
+    }
+    else if (param[0] == 4)
+      sendWord(scheduler.getSleepPermille());
+    break;
+#if defined(CONFIG_LOOP_PROFILER)
+  case 0x10:
+    if ((param[0] & 0x0F) < PROF_SECTIONS)
+    {
+      const LatencyHistogram &h = profiler.getHistogram((ProfiledSection)(param[0] & 0x0F));
+      sendWord(h.max);
+      for (byte i = 0; i < PROF_BUCKETS; i++)
+        sendWord(h.count[i]);
+    }
+    break;
+#endif
+  }
+}
+
+/**
+ * Command 0x08: remove the last entry before input pointer if it was not sent yet.
+ * Buffered command is removed as a whole including its parameters.
+ */
+void WinkeyProtocol::backspace()
+{
+  word end = fifo.getInputOffset();
+  word pos = 0;
+  word last = 0;
+  while (pos < end)
+  {
+    last = pos;
+    char x = fifo.peek(pos);
+    pos += TextBuffer::isTag(x) ? 1 + paramCount(x) : 1;
+  }
+  if (end > 0)
+    fifo.erase(last, pos - last);
+}
+
+/**
+ * Command 0x16: buffer pointer. Positions nn are counted in bytes from the beginning of current message,
+ * which is the first byte written while keyer was idle, or the first byte written after <16><00>.
+ * Buffered commands occupy their tag and parameter bytes.
+ * Positions already sent cannot be edited, pointer stops at the oldest unsent byte.
+ * <16><00>      input pointer back to the end of buffer, normal append mode; next byte has position 0
+ * <16><01><nn>  move input pointer to nn, overwrite mode
+ * <16><02><nn>  move input pointer to nn, insert (append at pointer) mode
+ * <16><03><nn>  put nn nulls at input pointer; nulls are skipped when sending, they reserve space for overwrite
+ */
+void WinkeyProtocol::handleBufferPointer()
+{
+  switch (param[0])
+  {
+  case 0:
+    fifo.setInputPointer(0, INPUT_APPEND);
+    fifo.markOrigin();
+    break;
+  case 1:
+    fifo.setInputPointer(param[1], INPUT_OVERWRITE);
+    break;
+  case 2:
+    fifo.setInputPointer(param[1], INPUT_INSERT);
+    break;
+  case 3:
+    for (byte i = 0; i < param[1] && fifo.canTake(); i++)
+      fifo.write(0);
+    break;
+  }
+}
+
 void WinkeyProtocol::ignore() {}
 
+/**
+ * Serial receive interrupt trampoline
+ */
+static void onSerialReceive(byte b, bool framingError)
+{
+  protocol.receive(b, framingError);
+}
+
 void WinkeyProtocol::init()
 {
-  Serial.begin(SERIAL_SPEED, SERIAL_8N1); // 1k2 is the only winkeyer protocol baud rate
   fifo.reset();
   phase = FETCH_ANY;
+  rxHead = rxTail = 0;
+  highBaud = false;
+  pendingBaud = BAUD_KEEP;
+#if defined(CONFIG_PROTOCOL_AUTOBAUD)
+  autobaudMs = halMillis() - AUTOBAUD_HOLD_MS;
+#endif
+  halSerialBegin(SERIAL_SPEED, onSerialReceive); // 1k2 is the WK2 baud rate, WK3 host can switch to SERIAL_SPEED_HIGH
+}
+
+/**
+ * Switch baud rate after everything queued so far was sent at the current one
+ * @param high true for SERIAL_SPEED_HIGH, false for SERIAL_SPEED
+ */
+void WinkeyProtocol::requestBaud(bool high)
+{
+  pendingBaud = high ? BAUD_HIGH : BAUD_LOW;
+}
+
+/**
+ * Apply requested baud rate change when transmitter is idle
+ */
+void WinkeyProtocol::handleBaudChange()
+{
+  if (pendingBaud == BAUD_KEEP || !txScheduler.isIdle() || !halSerialIsIdle())
+    return;
+  highBaud = (pendingBaud == BAUD_HIGH);
+  pendingBaud = BAUD_KEEP;
+  halSerialSetBaud(highBaud ? SERIAL_SPEED_HIGH : SERIAL_SPEED);
 }
 /**
  * @returns {bool} true if host is open, false otherwise
@@ -233,28 +472,65 @@ bool WinkeyProtocol::isHostOpen() { return _isHostOpen; }
 void WinkeyProtocol::sendPaddleEcho(byte ascii)
 {
   ascii = ascii & 0x7F;                    // mask off bit 7 which indicates status byte
-  if (echo.paddle == ON && (ascii >= ' ')) // send only printable characters
+  if (echo.paddle == ON && (ascii >= ' ') && !dumpActive) // send only printable characters
   {
-    Serial.write(ascii);
+    txScheduler.send(ascii);
   }
 }
 
+/**
+ * Serial echo of buffered text, called by keyer when the character starts on the air
+ */
+void WinkeyProtocol::sendSerialEcho(byte ascii)
+{
+  if (echo.serial == ON && !dumpActive)
+    txScheduler.send(ascii);
+}
+
+/**
+ * Send response byte, it is queued in bulk lane after previous responses and echo characters
+ */
 void WinkeyProtocol::sendResponse(byte x)
 {
-  Serial.write(x);
+  txScheduler.send(x);
+}
+
+/**
+ * Send speed pot byte (0x80 | value), it overtakes bulk bytes and replaces pot byte not sent yet.
+ * During EEPROM dump only the latest value is kept, sendEepromDump() sends it when the whole image is out.
+ */
+void WinkeyProtocol::sendPotValue(byte pot)
+{
+  if (dumpActive)
+    deferredPot = pot;
+  else
+    txScheduler.sendPot(pot);
+}
+
+/**
+ * Send 16-bit value, low byte first
+ */
+void WinkeyProtocol::sendWord(word w)
+{
+  sendResponse((byte)(w & 0xFF));
+  sendResponse((byte)(w >> 8));
 }
 
 void WinkeyProtocol::sendResponse(char *str, word length)
 {
-  Serial.write(str, length);
+  for (word i = 0; i < length; i++)
+    txScheduler.send(str[i]);
 }
 
 /**
- * Send Winkeyer2 status byte explicit value
+ * Send Winkeyer2 status byte explicit value. Status bytes overtake bulk bytes and replace status not sent yet.
  */
 void WinkeyProtocol::sendStatus(void)
 {
-  sendResponse(lastWkStatus);
+  if (dumpActive)
+    lastWkStatus = 0; // not a status byte: status is sent again as soon as the dump is out
+  else
+    txScheduler.sendStatus(lastWkStatus);
 }
 
 /**
@@ -262,9 +538,9 @@ void WinkeyProtocol::sendStatus(void)
  */
 void WinkeyProtocol::sendStatus(byte status)
 {
-  if (status != lastWkStatus)
+  if (status != lastWkStatus && !dumpActive) // status changed during EEPROM dump is sent after it
   {
-    sendResponse(status);
+    txScheduler.sendStatus(status);
     lastWkStatus = status;
   }
 }
@@ -285,9 +561,58 @@ void WinkeyProtocol::sendStatus(KeyerState kState)
 }
 
 /**
- * Reads serial port if character is available, except if previous character is still waiting to be processed.
- * Command characters are taken immediately into command buffer. All other characters are sent to circular text buffer
- * or stored temporarily in pendingChar in case of buffer congestion.
+ * Serial receive interrupt: text is appended straight to the text buffer, without any copy in the main loop.
+ * Command bytes with their parameters go to the receive ring for the parser in service().
+ * Text goes to the ring too whenever the parser is not idle, the ring is not empty, the buffer is being edited
+ * (input pointer mode) or full, so that the order of text and commands is always kept.
+ */
+void WinkeyProtocol::receive(byte b, bool framingError)
+{
+  scheduler.signal(); // new text for keyer or command for parser
+#if defined(CONFIG_PROTOCOL_AUTOBAUD)
+  if (!_isHostOpen)
+  {
+    unsigned long now = halMillis();
+    if (now - autobaudMs < AUTOBAUD_HOLD_MS)
+      return;
+    if (framingError || b >= 0x80)
+    {
+      highBaud = !highBaud; // host uses the other baud rate
+      halSerialSetBaud(highBaud ? SERIAL_SPEED_HIGH : SERIAL_SPEED);
+      autobaudMs = now;
+      return;
+    }
+  }
+#endif
+  if (framingError)
+    return;
+  if (b >= 0x20 && phase == FETCH_ANY && rxHead == rxTail && fifo.isAppending() && fifo.canTake())
+  {
+    if (!breakInFlag) // push character to buffer only if not in break condition
+    {
+      if (!fifo.hasMore() && keyState.source != SRC_BUFFER)
+        fifo.markOrigin(); // keyer is idle, new message starts
+      fifo.push(b);
+    }
+    return;
+  }
+  byte tail = rxTail;
+  byte next = (tail + 1) & (RX_RING_SIZE - 1);
+  if (next == rxHead)
+  {
+    rxOverruns++; // same as UART overrun: byte is lost
+    return;
+  }
+  rxRing[tail] = b;
+  rxTail = next;
+}
+
+/**
+ * Parse bytes from receive ring, except if previous character is still waiting to be processed.
+ * Command characters are taken immediately into command buffer. Text characters which did not go directly
+ * to the text buffer (see receive()) are written now, or wait in the ring in case of buffer congestion.
+ * A byte leaves the ring only after the parser phase reflects it, so that receive() never mistakes
+ * a command parameter for text.
  */
 void WinkeyProtocol::service(KeyerState _keyerState)
 {
@@ -295,11 +620,9 @@ void WinkeyProtocol::service(KeyerState _keyerState)
   keyState = _keyerState ;
   // Step 1: handle break-in and buffer send
   handleBreak();
-  input = Serial.peek();
+  input = (rxHead != rxTail) ? rxRing[rxHead] : -1;
   while (input >= 0 && (phase == EXPECT_ADMIN || phase == EXPECT_PARAMS || (phase == FETCH_ANY && (input <= 0x1F || fifo.canTake()))))
   {
-    // read one character
-    input = Serial.read();
     switch (phase)
     {
     case FETCH_ANY:
@@ -310,9 +633,7 @@ void WinkeyProtocol::service(KeyerState _keyerState)
       else if (input < 0x20)
       {
         command = input;
-        bytesExpected = parametersExpected[command];
-        if (bytesExpected == 255)
-          bytesExpected++; // only for donwload EEPROM command
+        bytesExpected = paramCount(command);
         bytesFetched = 0;
         if (bytesExpected > 0)
           phase = EXPECT_PARAMS;
@@ -326,23 +647,23 @@ void WinkeyProtocol::service(KeyerState _keyerState)
       {
         if (!breakInFlag) // push character to buffer only if not in break condition
         {
-          fifo.push(input);
-          if (echo.serial == ON)
-            Serial.write((char)input); // do serial echo
-          if (fifo.getFree() <= BUFFER_XOFF_LIMIT)
-            sendStatus(WKS_XOFF);
+          if (!fifo.hasMore() && keyState.source != SRC_BUFFER)
+            fifo.markOrigin(); // keyer is idle, new message starts
+          fifo.write(input);
         }
       }
       break;
     case EXPECT_ADMIN:
       command = 0x20 + input; // complete command code
-      if (command > 0x2D)
+      if (command > 0x32)
       { // invalid admin command code?
         phase = FETCH_ANY;
       }
       else
       {
-        bytesExpected = parametersExpected[command];
+        bytesExpected = paramCount(command);
+        if (bytesExpected == 255)
+          bytesExpected++; // only for load EEPROM command, 256 bytes do not fit the table
         bytesFetched = 0;
         if (bytesExpected > 0)
           phase = EXPECT_PARAMS;
@@ -357,10 +678,10 @@ void WinkeyProtocol::service(KeyerState _keyerState)
       if (bytesExpected > 0)
       {
         if (bytesFetched < 16)
-          param[bytesFetched] = input; // ignore bytes after 16th byte, this is part of ignoring EEPROM download
+          param[bytesFetched] = input; // EEPROM image: magic and defaults block fit, the rest is ignored
         bytesFetched++;
-        if (command == 0x16 && bytesFetched == 1 && input == 3)
-          bytesExpected++; // command Buffer Pointer Command has extra byte if parameter == 3
+        if (command == 0x16 && bytesFetched == 1 && input >= 1 && input <= 3)
+          bytesExpected++; // command Buffer Pointer Command has extra byte if parameter is 1, 2 or 3
         bytesExpected--;
       }
       if (bytesExpected == 0)
@@ -368,15 +689,42 @@ void WinkeyProtocol::service(KeyerState _keyerState)
     default:
       break;
     }
-    input = Serial.peek();
+    rxHead = (rxHead + 1) & (RX_RING_SIZE - 1);
+    input = (rxHead != rxTail) ? rxRing[rxHead] : -1;
   }
   if (phase == EXECUTE)
     executeCommand();
+  // text arrives in interrupt, so buffer congestion is reported here
+  if (!bufferFull && fifo.getFree() <= BUFFER_XOFF_LIMIT)
+  {
+    bufferFull = true;
+    sendStatus(WKS_XOFF);
+  }
+  else if (bufferFull && fifo.getFree() > BUFFER_XON_LIMIT)
+  {
+    bufferFull = false;
+    sendStatus(fifo.hasMore() ? WKS_XON : WKS_READY); // send XON if buffer was partially freed
+  }
+  sendEepromDump();
+  txScheduler.service(); // send what waits for serial port; never blocks
+  handleBaudChange();
+}
+
+/**
+ * Tell scheduler whether service() or getNextMorseCode() have work to do right now. Text and commands
+ * arriving later wake the CPU by serial interrupt.
+ */
+void WinkeyProtocol::schedule()
+{
+  if (rxHead != rxTail && (rxRing[rxHead] < 0x20 || phase != FETCH_ANY || fifo.canTake()))
+    scheduler.wakeNow(); // parser did not finish, it takes one command per loop
+  else if (phase == EXECUTE || pendingBaud != BAUD_KEEP || (fifo.hasMore() && keyer.canAccept()) ||
+           (eepromDumpIndex < WINKEY_EEPROM_SIZE && txScheduler.canSend()))
+    scheduler.wakeNow();
 }
 
-void WinkeyProtocol::setModeParameters()
+void WinkeyProtocol::setModeParameters(byte wkMode)
 {
-  byte wkMode = param[0];
   // TODO: paddle watchdog (implement in KeyingInterface)
   // keyer.setPaddleWatchdog( wkMode & 0x80 )
   // TODO: paddle echo (implement in KeyingInterface)
@@ -395,8 +743,7 @@ void WinkeyProtocol::setModeParameters()
     break;
   default:;
   }
-  if (wkMode & 8)
-    paddle.swap();
+  paddle.setSwap((wkMode & 8) != 0);
   echo.serial = (wkMode & 4) ? ON : OFF;
   echo.paddle = (wkMode & 0x40) ? ON : OFF;
   // TODO: autospace (implement in KeyingInterface)
@@ -405,6 +752,58 @@ void WinkeyProtocol::setModeParameters()
   // keyer.setContestSpacing( wkMode & 1 )
 }
 
+/**
+ * Sidetone control value of command 0x01: 4000 / frequency in Hz in low nibble, bit 7 = paddle only.
+ * Zero keeps the current frequency.
+ */
+void WinkeyProtocol::setSidetone(byte value)
+{
+  _sidetonePaddleOnly = (value & 0x80) != 0;
+  value = value & 0x0F;
+  if (value != 0)
+    keyer.setToneFreq(WINKEY_SIDETONE_FREQ / value);
+}
+
+/**
+ * Apply Winkeyer defaults block held by settings: restored from EEPROM at power-up, or loaded by host
+ * (0x0F, EEPROM image). Buffer speed is not part of it, it follows paddle speed until host sets it.
+ */
+void WinkeyProtocol::applySettings()
+{
+  setModeParameters(settings.get(SETTING_MODE));
+  setSidetone(settings.get(SETTING_SIDETONE));
+  keyer.setTimingParameters((settings.get(SETTING_RATIO) * 300U) / 50U, settings.get(SETTING_WEIGHT));
+  keyer.setPttTiming(settings.get(SETTING_LEAD), settings.get(SETTING_TAIL));
+  keyer.setFirstExtension(settings.get(SETTING_EXTENSION));
+  keyer.setQskCompensation(settings.get(SETTING_COMPENSATION));
+  keyer.setFarnsworthWpm(settings.get(SETTING_FARNSWORTH));
+  keyer.setPaddleSwitchpoint(settings.get(SETTING_SWITCHPOINT));
+  byte minWpm = settings.get(SETTING_MIN_WPM);
+  speedControl->setMinMax(minWpm, minWpm + settings.get(SETTING_WPM_RANGE));
+  speedControl->setValue(settings.get(SETTING_SPEED));
+}
+
+/**
+ * Admin command 0x2C: Winkeyer EEPROM image, 256 bytes: magic, defaults block, zeros (no stored messages).
+ * Bytes are queued only while the bulk lane has room, the dump takes about 2 s at 1200 Bd.
+ * Status, speed pot and echo bytes would overtake or split the image, they wait until it has been transmitted.
+ */
+void WinkeyProtocol::sendEepromDump()
+{
+  while (eepromDumpIndex < WINKEY_EEPROM_SIZE && txScheduler.canSend())
+  {
+    word i = eepromDumpIndex++;
+    txScheduler.send((i == 0) ? WINKEY_EEPROM_MAGIC : (i <= SETTINGS_SIZE) ? settings.get((SettingIndex)(i - 1)) : 0);
+  }
+  if (dumpActive && eepromDumpIndex == WINKEY_EEPROM_SIZE && txScheduler.isIdle())
+  {
+    dumpActive = false; // the whole image is out, status and pot bytes cannot split it any more
+    if (deferredPot)
+      sendPotValue(deferredPot);
+    deferredPot = 0;
+  }
+}
+
 // void WinkeyProtocol::setStatus(KeyerStateWord keyState) {
 //   byte status = wkStatusFromKeyerState( keyState ) ;
 //   statusChanged = statusChanged || (status != wkStatus) ;
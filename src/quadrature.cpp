@@ -0,0 +1,83 @@
+#include "quadrature.h"
+
+/**
+ * Phase change for transition from previous state (bits 3-2) to new state (bits 1-0);
+ * 0 = no change or invalid transition. Forward sequence is A/B 00 -> 10 -> 11 -> 01 -> 00,
+ * i.e. clock rises while data is low.
+ */
+static const signed char TRANSITION[16] = {
+    0, -1, +1, 0,  // from 00
+    +1, 0, 0, -1,  // from 01
+    -1, 0, 0, +1,  // from 10
+    0, +1, -1, 0}; // from 11
+
+/**
+ * @return true if state is a rest state (detent) of the encoder
+ */
+bool QuadratureDecoder::isRest(byte state)
+{
+  return (state == 3) || (CONFIG_SPEED_ROTARY_STEPS == 2 && state == 0);
+}
+
+void QuadratureDecoder::reset(byte state)
+{
+  ab = state & 3;
+  phase = 0;
+}
+
+/**
+ * Process new contact state.
+ * @param state bit 1 = A (clock), bit 0 = B (data)
+ * @param us micros() of the change, for acceleration
+ */
+void QuadratureDecoder::edge(byte state, unsigned long us)
+{
+  state &= 3;
+  if (state == ab) return; // the other pin of the port changed, or bounce already settled
+  byte index = (ab << 2) | state;
+  ab = state;
+  if ((ab ^ (index >> 2)) == 3) { // both contacts changed: two steps at once, assume the move continues
+    invalid = invalid + 1;
+    signed char direction = (phase > 0) ? 1 : (phase < 0) ? -1 : lastDirection;
+    phase += 2 * direction;
+  }
+  else phase += TRANSITION[index];
+  if (!isRest(state)) return;
+  signed char direction = (phase > CONFIG_SPEED_ROTARY_STEPS / 2) ? 1 : (phase < -CONFIG_SPEED_ROTARY_STEPS / 2) ? -1 : 0;
+  phase = 0;
+  if (direction == 0) return; // partial move or bounce only
+  int steps = 1;
+  unsigned long interval = us - lastDetentUs;
+  if (direction == lastDirection) {
+    if (interval < CONFIG_SPEED_ROTARY_ACCEL_FAST_US) steps = CONFIG_SPEED_ROTARY_ACCEL_FAST;
+    else if (interval < CONFIG_SPEED_ROTARY_ACCEL_MEDIUM_US) steps = CONFIG_SPEED_ROTARY_ACCEL_MEDIUM;
+  }
+  lastDirection = direction;
+  lastDetentUs = us;
+  total = total + direction * steps;
+}
+
+/**
+ * The total is wider than one byte, so the main loop may read it in two parts with an interrupt in between.
+ * Reading it until two successive reads agree gives a value that really existed, without blocking the interrupt.
+ * @return running total of detents
+ */
+int QuadratureDecoder::snapshot()
+{
+  int a, b;
+  do {
+    a = total;
+    b = total;
+  } while (a != b);
+  return a;
+}
+
+word QuadratureDecoder::getInvalid()
+{
+  word a, b;
+  do {
+    a = invalid;
+    b = invalid;
+  } while (a != b);
+  return a;
+}
@@ -5,53 +5,65 @@
  * Jindrich Vavruska, jindrich@vavruska.cz
  **/
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include <Arduino.h>
 
 #include "config_speedcontrol.h"
 #include "rotary_encoder.h"
+#include "quadrature.h"
+#include "scheduler.h"
 
 #if defined (CONFIG_SPEED_TYPE_ROTARY)
 
-/* Rotary encoder vector and mask calculation */
+/* Rotary encoder vector and mask calculation, both contacts must be on the same port */
 #if CONFIG_SPEED_ROTARY_CLOCK > 1 && CONFIG_SPEED_ROTARY_CLOCK < 8
 #define ROT_INT_VECTOR PCINT2_vect
 #define ROT_INT_MASK_REG PCMSK2
-#define ROT_INT_MASK (1 << (PIN_ROTARY_CLOCK))
 #define ROT_PCIE_MASK (1 << PCIE2)
 #define ROT_PINS PIND
-#define ROT_PC_INTERRUPT
+#define ROT_PORT_FIRST 0
+#define ROT_PORT_LAST 7
 
 #elif CONFIG_SPEED_ROTARY_CLOCK > 7 && CONFIG_SPEED_ROTARY_CLOCK < 14
 #define ROT_INT_VECTOR PCINT0_vect
 #define ROT_INT_MASK_REG PCMSK0
-#define ROT_INT_MASK (1 << (CONFIG_SPEED_ROTARY_CLOCK - 8))
 #define ROT_PCIE_MASK (1 << PCIE0)
 #define ROT_PINS PINB
-#define ROT_PC_INTERRUPT
+#define ROT_PORT_FIRST 8
+#define ROT_PORT_LAST 13
 
 #elif CONFIG_SPEED_ROTARY_CLOCK > 13 && CONFIG_SPEED_ROTARY_CLOCK < 20
 #define ROT_INT_VECTOR PCINT1_vect
 #define ROT_INT_MASK_REG PCMSK1
-#define ROT_INT_MASK (1 << (PIN_ROTARY_CLOCK - 14))
 #define ROT_PCIE_MASK (1 << PCIE1)
 #define ROT_PINS PINC
-#define ROT_PC_INTERRUPT
+#define ROT_PORT_FIRST 14
+#define ROT_PORT_LAST 19
 #else
 #error "Cannot determine interrupt configuration for rotary encoder"
 #endif
 
-#if CONFIG_SPEED_ROTARY_DATA < 8
-#define ROT_VALUE_SHIFT CONFIG_SPEED_ROTARY_DATA
-#elif PIN_ROTARY_VALUE < 14
-#define ROT_VALUE_SHIFT CONFIG_SPEED_ROTARY_DATA - 8
-#else
-#define ROT_VALUE_SHIFT CONFIG_SPEED_ROTARY_DATA - 14
+#if CONFIG_SPEED_ROTARY_DATA < ROT_PORT_FIRST || CONFIG_SPEED_ROTARY_DATA > ROT_PORT_LAST
+#error "Rotary encoder clock and data must be on the same port"
 #endif
 
+#define ROT_CLOCK_SHIFT (CONFIG_SPEED_ROTARY_CLOCK - ROT_PORT_FIRST)
+#define ROT_DATA_SHIFT (CONFIG_SPEED_ROTARY_DATA - ROT_PORT_FIRST)
+#define ROT_INT_MASK ((1 << ROT_CLOCK_SHIFT) | (1 << ROT_DATA_SHIFT))
+
 RotaryEncoder encoder ;
 
-volatile bool isEventPending = false ; // indicates need to update rotary encoder value
-volatile int  interruptIncrement = 0 ; // increment accumulated from ISR
+static QuadratureDecoder decoder ; // written by interrupt only
+static int lastTotal = 0 ;         // decoder total already applied to value
+
+/**
+ * @return contact state for decoder: bit 1 = clock, bit 0 = data
+ */
+static inline byte readContacts()
+{
+  byte pins = ROT_PINS ;
+  return (((pins >> ROT_CLOCK_SHIFT) & 1) << 1) | ((pins >> ROT_DATA_SHIFT) & 1) ;
+}
 
 /**
  * Initialize ports and enable interrupt
@@ -61,6 +73,9 @@ void RotaryEncoder::init()
   pinMode(CONFIG_SPEED_ROTARY_CLOCK, INPUT_PULLUP);
   pinMode(CONFIG_SPEED_ROTARY_DATA, INPUT_PULLUP);
   pinMode( CONFIG_CMD_MODE_LED, OUTPUT );
+  disableInterrupt();
+  decoder.reset(readContacts());
+  lastTotal = decoder.snapshot();
   enableInterrupt();
 }
 
@@ -83,29 +98,23 @@ void RotaryEncoder::setValue( int v ) {
 }
 
 /**
- * Update speed control value. In case of rotary encoder check if there are
- * any data collected by interrupt routine and update the value accordingly.
+ * Update speed control value. In case of rotary encoder take detents counted
+ * by interrupt routine since the last update. Interrupt keeps running meanwhile.
  */
 void RotaryEncoder::update()
 {
-  // if(!isEventPending) return ; // do nothing if nothing happened
-  if( interruptIncrement == 0 ) return ;
-  byte _pcicr = PCICR & ROT_PCIE_MASK ; // remember original interrupt state
-  PCICR &= ~ROT_PCIE_MASK; // disable interrupt while reading 
-  valueIncrement = interruptIncrement ;
-  interruptIncrement = 0;
-  isEventPending = false ;
-  if( value + valueIncrement > 0 ) {
-    value = cropValue(value + valueIncrement) ;
-  }
-  PCICR = PCICR | _pcicr; // return original value - enable interrupt if previously enabled
+  int total = decoder.snapshot() ;
+  valueIncrement = total - lastTotal ;
+  if( valueIncrement == 0 ) return ;
+  lastTotal = total ;
+  value = cropValue(value + valueIncrement) ;
 }
 
 /**
  * Enables interrupt to act
  */
 void RotaryEncoder::enableInterrupt() {
-  ROT_INT_MASK_REG = ROT_INT_MASK;
+  ROT_INT_MASK_REG |= ROT_INT_MASK;
   PCICR |= ROT_PCIE_MASK;
 }
 
@@ -117,13 +126,7 @@ void RotaryEncoder::disableInterrupt()
 
 ISR(ROT_INT_VECTOR)
 {
-  if( !isEventPending ) {
-    byte state = ROT_PINS ;
-    if( state & ROT_INT_MASK ) {
-      state = (state >> (ROT_VALUE_SHIFT)) & 1 ;
-      interruptIncrement += ( 1 - 2*state );
-      isEventPending = true ;
-    }
-  }
+  decoder.edge(readContacts(), micros());
+  scheduler.signal(); // speed value to be updated in main loop
 }
 #endif
\ No newline at end of file
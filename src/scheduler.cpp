@@ -0,0 +1,77 @@
+#include "hal.h"
+#include "scheduler.h"
+
+TaskScheduler scheduler; // scheduler singleton
+
+#if defined(CONFIG_IDLE_SLEEP)
+
+const unsigned long STATS_WINDOW_US = 60000000UL; // sleep statistics age by half every minute
+
+void TaskScheduler::startLoop()
+{
+  eventPending = false;
+  workPending = false;
+  hasDeadline = false;
+}
+
+void TaskScheduler::wakeNow() { workPending = true; }
+
+void TaskScheduler::wakeAt(unsigned long us)
+{
+  if (!hasDeadline || (long)(us - deadline) < 0) // earlier than current one, safe across micros() wraparound
+    deadline = us;
+  hasDeadline = true;
+}
+
+/**
+ * Idle sleep until the next interrupt if nothing is due. Interrupt that comes after the decision
+ * but before the sleep instruction wakes the CPU immediately.
+ */
+void TaskScheduler::sleep()
+{
+  unsigned long start = halMicros();
+  ageStats(start);
+  if (workPending)
+    return;
+  if (hasDeadline && (long)(deadline - start) <= (long)CONFIG_SLEEP_GUARD_US)
+    return; // too close, keep spinning to meet it exactly
+  halNoInterrupts();
+  if (eventPending)
+  {
+    halInterrupts();
+    return;
+  }
+  halIdle(); // enables interrupts
+  sleptUs += halMicros() - start;
+}
+
+/**
+ * When the statistics window is full, halve both slept and elapsed time: the ratio follows the last
+ * minutes and 32-bit microsecond counters never wrap, however long the keyer runs.
+ */
+void TaskScheduler::ageStats(unsigned long now)
+{
+  unsigned long elapsed = now - statsStart;
+  if (elapsed >= STATS_WINDOW_US)
+  {
+    sleptUs >>= 1;
+    statsStart = now - (elapsed >> 1);
+  }
+}
+
+void TaskScheduler::resetStats()
+{
+  sleptUs = 0;
+  statsStart = halMicros();
+}
+
+/**
+ * @return fraction of time spent in idle sleep in 1/1000, time older than a minute weighs less and less
+ */
+word TaskScheduler::getSleepPermille()
+{
+  unsigned long totalMs = (halMicros() - statsStart) / 1000UL;
+  return (totalMs > 0) ? (word)(sleptUs / totalMs) : 0; // microseconds per millisecond = 1/1000
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "hal.h"
+#include "challenger.h"
+#include "settings.h"
+
+SettingsStore settings; // persistent settings singleton
+
+// Iambic B with serial and paddle echo, 25 WPM, keyer default sidetone, weighting 50, speed range 15-46 WPM
+const byte FACTORY_DEFAULTS[SETTINGS_SIZE] PROGMEM = {
+    0x44, 25, 0, 50, // mode, speed, sidetone, weight
+    0, 0, 15, 31,    // PTT lead, PTT tail, min WPM, WPM range
+    0, 0, 10, 0,     // 1st extension, key compensation, Farnsworth WPM, paddle switchpoint
+    50, 0, 0};       // dah:dit ratio, pin config, reserved
+
+/**
+ * CRC-8, polynomial 0x07. Initial value 0xFF, so that neither an erased (0xFF) nor a zeroed slot passes.
+ */
+byte SettingsStore::crc8(const byte *data, byte length)
+{
+  byte crc = 0xFF;
+  for (byte i = 0; i < length; i++)
+  {
+    crc ^= data[i];
+    for (byte bit = 0; bit < 8; bit++)
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+  }
+  return crc;
+}
+
+word SettingsStore::slotAddress(byte slot) { return CONFIG_SETTINGS_EEPROM_BASE + (word)slot * RECORD_SIZE; }
+
+/**
+ * Restore settings from the newest valid record. Valid records carry consecutive sequence numbers,
+ * so the newest one is ahead of all others by less than 128, also when the counter wraps.
+ * @return true if settings were restored, false if there is no valid record and factory defaults apply
+ */
+bool SettingsStore::load()
+{
+  bool found = false;
+  for (byte s = 0; s < CONFIG_SETTINGS_SLOTS; s++)
+  {
+    for (byte i = 0; i < RECORD_SIZE; i++)
+      record[i] = halEepromRead(slotAddress(s) + i);
+    if (crc8(record, RECORD_SIZE - 1) != record[RECORD_SIZE - 1])
+      continue;
+    if (!found || (int8_t)(record[0] - sequence) > 0)
+    {
+      found = true;
+      slot = s;
+      sequence = record[0];
+      memcpy(values, record + 1, SETTINGS_SIZE);
+    }
+  }
+  if (!found)
+    for (byte i = 0; i < SETTINGS_SIZE; i++)
+      values[i] = pgm_read_byte(&FACTORY_DEFAULTS[i]);
+  writeIndex = RECORD_SIZE;
+  dirty = false;
+  return found;
+}
+
+byte SettingsStore::get(SettingIndex index) { return values[index]; }
+
+void SettingsStore::set(SettingIndex index, byte value)
+{
+  if (values[index] == value)
+    return; // loggers repeat their settings at every Host Open, nothing to save then
+  values[index] = value;
+  dirty = true;
+  changedMs = currentTime;
+}
+
+void SettingsStore::setAll(const byte *block)
+{
+  for (byte i = 0; i < SETTINGS_SIZE; i++)
+    set((SettingIndex)i, block[i]);
+}
+
+/**
+ * Save changed settings into the slot after the newest record, one byte per call.
+ * Settings and CRC are written first and the sequence number last: until then the slot keeps the sequence
+ * number of the oldest record, so a record torn by power loss can never win at the next power-up,
+ * even if its CRC happened to match.
+ */
+void SettingsStore::service()
+{
+  if (writeIndex < RECORD_SIZE)
+  {
+    if (!halEepromReady())
+      return;
+    byte next = (slot + 1 < CONFIG_SETTINGS_SLOTS) ? slot + 1 : 0;
+    byte i = (writeIndex + 1 < RECORD_SIZE) ? writeIndex + 1 : 0; // sequence number last
+    halEepromWrite(slotAddress(next) + i, record[i]);
+    if (++writeIndex == RECORD_SIZE)
+    {
+      slot = next;
+      sequence = record[0];
+    }
+  }
+  else if (dirty && currentTime - changedMs >= CONFIG_SETTINGS_SAVE_MS)
+  {
+    record[0] = sequence + 1;
+    memcpy(record + 1, values, SETTINGS_SIZE);
+    record[RECORD_SIZE - 1] = crc8(record, RECORD_SIZE - 1);
+    writeIndex = 0;
+    dirty = false;
+  }
+}
+
+bool SettingsStore::isSaving() { return dirty || writeIndex < RECORD_SIZE; }
@@ -0,0 +1,85 @@
+#include "sidetone.h"
+#include "hal.h"
+
+#if !defined(CHALLENGER_NATIVE)
+
+#include <avr/io.h>
+
+Sidetone sidetone; // sidetone singleton
+
+word Sidetone::getFrequency() { return frequency; }
+
+#if defined(SIDETONE_HW_TIMER)
+
+#if CONFIG_KEYING_SIDETONE == 11
+#define SIDETONE_COM_TOGGLE (1 << COM2A0) // toggle OC2A on compare match
+#else
+#define SIDETONE_COM_TOGGLE (1 << COM2B0) // toggle OC2B on compare match
+#endif
+#define SIDETONE_CTC (1 << WGM21)       // clear timer on compare match A, TOP = OCR2A
+
+/** Timer2 prescalers, index is the clock select value */
+static const word PRESCALER[] = {0, 1, 8, 32, 64, 128, 256, 1024};
+
+/**
+ * Timer2 runs in CTC mode all the time, with output disconnected the pin is driven by its PORT bit (low)
+ */
+void Sidetone::init()
+{
+  halPinMode(CONFIG_KEYING_SIDETONE, OUTPUT);
+  halDigitalWrite(CONFIG_KEYING_SIDETONE, LOW);
+  TIMSK2 = 0; // no interrupts
+  TCCR2A = SIDETONE_CTC;
+  OCR2B = 0;
+  setFrequency(600);
+}
+
+/**
+ * Choose the smallest prescaler which makes the half period fit 8 bits, for the best frequency resolution
+ * @param hz tone frequency
+ */
+void Sidetone::setFrequency(word hz)
+{
+  if (hz == 0 || hz == frequency) return;
+  frequency = hz;
+  unsigned long counts = 0;
+  byte cs;
+  for (cs = 1; cs < 7; cs++) {
+    counts = F_CPU / (2UL * PRESCALER[cs] * hz);
+    if (counts <= 256) break;
+  }
+  if (cs == 7) counts = F_CPU / (2UL * PRESCALER[cs] * hz);
+  if (counts > 256) counts = 256;
+  if (counts == 0) counts = 1;
+  clockSelect = cs;
+  top = counts - 1;
+  TCCR2B = clockSelect;
+  OCR2A = top;
+  if (TCNT2 > top) TCNT2 = 0; // compare match would be missed for a whole 8-bit wrap
+}
+
+void Sidetone::on() { TCCR2A = SIDETONE_CTC | SIDETONE_COM_TOGGLE; }
+
+void Sidetone::off() { TCCR2A = SIDETONE_CTC; }
+
+#else
+
+void Sidetone::init()
+{
+  if (CONFIG_KEYING_SIDETONE > 0)
+    halPinMode(CONFIG_KEYING_SIDETONE, OUTPUT);
+  frequency = 600;
+}
+
+void Sidetone::setFrequency(word hz)
+{
+  if (hz > 0) frequency = hz;
+}
+
+void Sidetone::on() { halTone(CONFIG_KEYING_SIDETONE, frequency); }
+
+void Sidetone::off() { halNoTone(CONFIG_KEYING_SIDETONE); }
+
+#endif
+
+#endif
@@ -0,0 +1,95 @@
+#include "hal.h"
+#include "tx_scheduler.h"
+
+TxScheduler txScheduler; // transmit scheduler singleton
+
+void TxScheduler::saturatedIncrement(word &counter)
+{
+  if (counter < 0xFFFF)
+    counter++;
+}
+
+/**
+ * Queue status byte. It replaces the last pending status if it keeps its break-in and XOFF bits,
+ * otherwise it is queued behind it. With two pending already, the oldest one gives way, so that
+ * the host still sees the latest transition and the state it leads to.
+ */
+void TxScheduler::sendStatus(byte status)
+{
+  byte last = pendingStatus[1] ? 1 : 0;
+  if (pendingStatus[last] && ((pendingStatus[last] ^ status) & STATUS_EDGES))
+  {
+    if (last == 1)
+    {
+      saturatedIncrement(dropped[TX_PRIORITY]);
+      pendingStatus[0] = pendingStatus[1];
+    }
+    last = 1;
+  }
+  else if (pendingStatus[last])
+    saturatedIncrement(dropped[TX_PRIORITY]);
+  pendingStatus[last] = status;
+  service();
+}
+
+void TxScheduler::sendPot(byte pot)
+{
+  if (pendingPot)
+    saturatedIncrement(dropped[TX_PRIORITY]);
+  pendingPot = pot;
+  service();
+}
+
+void TxScheduler::send(byte b)
+{
+  byte next = (bulkTail + 1) & (BULK_SIZE - 1);
+  if (next == bulkHead)
+    saturatedIncrement(dropped[TX_BULK]);
+  else
+  {
+    bulk[bulkTail] = b;
+    bulkTail = next;
+  }
+  service();
+}
+
+/**
+ * Feed UART driver: priority lane first, then bulk lane. Called from every send method
+ * and from protocol service in every loop iteration.
+ */
+void TxScheduler::service()
+{
+  while (halSerialCanWrite())
+  {
+    if (pendingStatus[0])
+    {
+      halSerialWrite(pendingStatus[0]);
+      pendingStatus[0] = pendingStatus[1];
+      pendingStatus[1] = 0;
+    }
+    else if (pendingPot)
+    {
+      halSerialWrite(pendingPot);
+      pendingPot = 0;
+    }
+    else if (bulkHead != bulkTail)
+    {
+      halSerialWrite(bulk[bulkHead]);
+      bulkHead = (bulkHead + 1) & (BULK_SIZE - 1);
+    }
+    else
+      break;
+  }
+}
+
+bool TxScheduler::canSend() { return ((bulkTail + 1) & (BULK_SIZE - 1)) != bulkHead; }
+
+bool TxScheduler::isIdle() { return !pendingStatus[0] && !pendingPot && bulkHead == bulkTail; }
+
+word TxScheduler::getDropped(TxLane lane) { return dropped[lane < TX_LANES ? lane : TX_BULK]; }
+
+void TxScheduler::resetDropped()
+{
+  dropped[TX_PRIORITY] = 0;
+  dropped[TX_BULK] = 0;
+}
@@ -0,0 +1,102 @@
+#include "uart.h"
+
+#if !defined(CHALLENGER_NATIVE)
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+Uart uart; // USART0 driver singleton
+
+static Uart::Receiver receiver = 0;
+static volatile byte txBuffer[Uart::TX_BUFFER_SIZE];
+static volatile byte txHead = 0; // next byte to be sent, moved by interrupt
+static volatile byte txTail = 0; // next free position, moved by write()
+static bool written = false;     // anything sent since begin(), TXC0 is meaningful only then
+
+/**
+ * Setup USART0 in double speed mode
+ */
+void Uart::begin(unsigned long baud, Receiver r)
+{
+  receiver = r;
+  UCSR0B = 0;
+  UCSR0A = (1 << U2X0);
+  setBaud(baud);
+  UCSR0C = (1 << UCSZ01) | (1 << UCSZ00); // 8N1
+  txHead = txTail = 0;
+  written = false;
+  UCSR0B = (1 << RXEN0) | (1 << TXEN0) | (1 << RXCIE0);
+}
+
+/**
+ * Change baud rate without touching buffers; same divider as HardwareSerial::begin() in double speed mode.
+ * Byte being received or sent at that moment is lost.
+ */
+void Uart::setBaud(unsigned long baud)
+{
+  word divider = (F_CPU / 4 / baud - 1) / 2;
+  UBRR0H = divider >> 8;
+  UBRR0L = divider & 0xFF;
+}
+
+/**
+ * @return true if everything written was completely shifted out
+ */
+bool Uart::isIdle()
+{
+  return !written || (txHead == txTail && (UCSR0A & (1 << TXC0)));
+}
+
+/**
+ * Send next byte from ring buffer. Interrupts must be disabled.
+ */
+static inline void sendNext()
+{
+  byte head = txHead;
+  UCSR0A = (UCSR0A & (1 << U2X0)) | (1 << TXC0); // clear transmit complete flag, keep double speed
+  UDR0 = txBuffer[head];
+  txHead = head = (head + 1) & (Uart::TX_BUFFER_SIZE - 1);
+  if (head == txTail)
+    UCSR0B &= ~(1 << UDRIE0);
+}
+
+/**
+ * Queue byte for sending. When the buffer is full, wait until there is a free position;
+ * with interrupts disabled the data register is polled instead.
+ */
+void Uart::write(byte b)
+{
+  byte next = (txTail + 1) & (TX_BUFFER_SIZE - 1);
+  while (next == txHead)
+  {
+    if (!(SREG & (1 << SREG_I)) && (UCSR0A & (1 << UDRE0)))
+      sendNext();
+  }
+  txBuffer[txTail] = b;
+  written = true;
+  byte sreg = SREG;
+  cli();
+  txTail = next;
+  UCSR0B |= (1 << UDRIE0);
+  SREG = sreg;
+}
+
+bool Uart::canWrite()
+{
+  return ((txTail + 1) & (TX_BUFFER_SIZE - 1)) != txHead;
+}
+
+ISR(USART_RX_vect)
+{
+  byte status = UCSR0A;
+  byte b = UDR0;
+  if (receiver) // framing error: line noise, baud change, or host using another baud rate
+    receiver(b, (status & (1 << FE0)) != 0);
+}
+
+ISR(USART_UDRE_vect)
+{
+  sendNext();
+}
+
+#endif